@@ -0,0 +1,389 @@
+/* convoLV2 -- LV2 convolution plugin
+ *
+ * Copyright (C) 2012 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Offline benchmark of the convolution engine.
+ *
+ * Sweeps IR length, block-size, channel layout and density,
+ * and reports initialization time, processing time per sample,
+ * the resulting DSP load and the peak resident set size.
+ * With -p, instances are initialized concurrently instead, as by a host
+ * that restores a session.
+ *
+ *   convoLV2-bench [-c] [-d seconds] [-e engine] [-p instances] [-r rate] [-q] [-w] [-y]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <sndfile.h>
+
+#include "convolution.h"
+
+static double now_ms (void) {
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static long peak_rss_kb (void) {
+	struct rusage ru;
+	if (getrusage (RUSAGE_SELF, &ru)) {
+		return -1;
+	}
+#ifdef __APPLE__
+	return ru.ru_maxrss / 1024;
+#else
+	return ru.ru_maxrss;
+#endif
+}
+
+static float noise (void) {
+	return rand () / (float) RAND_MAX - .5f;
+}
+
+/** write exponentially decaying noise, returns 0 on success */
+static int write_ir (const char *fn, unsigned int n_chan, unsigned int n_frames, unsigned int rate) {
+	SF_INFO nfo;
+	memset (&nfo, 0, sizeof (nfo));
+	nfo.channels = n_chan;
+	nfo.samplerate = rate;
+	nfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+	SNDFILE *sf = sf_open (fn, SFM_WRITE, &nfo);
+	if (!sf) {
+		fprintf (stderr, "bench: cannot write IR '%s': %s\n", fn, sf_strerror (NULL));
+		return -1;
+	}
+
+	float *buf = (float*) malloc (n_chan * n_frames * sizeof (float));
+	if (!buf) {
+		sf_close (sf);
+		return -1;
+	}
+	const float decay = -6.9f / n_frames; // -60dB at the end
+	for (unsigned int i = 0; i < n_frames; ++i) {
+		for (unsigned int c = 0; c < n_chan; ++c) {
+			buf[i * n_chan + c] = noise () * expf (decay * i);
+		}
+	}
+	sf_count_t written = sf_writef_float (sf, buf, n_frames);
+	sf_close (sf);
+	free (buf);
+	return written == (sf_count_t) n_frames ? 0 : -1;
+}
+
+static const char *engine = "zita";
+static int hybrid = 0;
+static int compact = 0;
+static int warmup = 0;
+
+static int bench (const char *ir_fn, unsigned int ir_len,
+		unsigned int block_size, unsigned int n_in, unsigned int n_out,
+		float density, double seconds, unsigned int rate)
+{
+	char val[32];
+	float *inp[MAX_CHANNELS];
+	float *out[MAX_CHANNELS];
+	unsigned int c;
+	double t_init;
+	int rv = -1;
+
+	LV2convolv *clv = clv_alloc ();
+	if (!clv) {
+		return -1;
+	}
+
+	clv_configure (clv, "convolution.ir.file", ir_fn);
+	clv_configure (clv, "convolution.engine", engine);
+	clv_configure (clv, "convolution.hybrid", hybrid ? "1" : "0");
+	clv_configure (clv, "convolution.compact", compact ? "1" : "0");
+	snprintf (val, sizeof (val), "%u", ir_len);
+	clv_configure (clv, "convolution.maxsize", val);
+	snprintf (val, sizeof (val), "%f", density);
+	clv_configure (clv, "convolution.density", val);
+
+	memset (inp, 0, sizeof (inp));
+	memset (out, 0, sizeof (out));
+
+	t_init = now_ms ();
+	if (clv_initialize (clv, rate, n_in, n_out, block_size)) {
+		printf ("%8u %6u %2ux%u  %4.2f  initialization failed\n", ir_len, block_size, n_in, n_out, density);
+		goto errout;
+	}
+	if (warmup) {
+		clv_warmup (clv);
+	}
+	t_init = now_ms () - t_init;
+
+	for (c = 0; c < n_in; ++c) {
+		if (!(inp[c] = (float*) malloc (block_size * sizeof (float)))) goto errout;
+		for (unsigned int i = 0; i < block_size; ++i) {
+			inp[c][i] = noise ();
+		}
+	}
+	for (c = 0; c < n_out; ++c) {
+		if (!(out[c] = (float*) malloc (block_size * sizeof (float)))) goto errout;
+	}
+
+	{
+		/* process `seconds' of audio, or until 4 times that wall-clock time has passed */
+		const unsigned long n_blocks = 1 + seconds * rate / block_size;
+		const double t_max = 4e3 * seconds;
+		unsigned long n;
+
+		/* the first period after initialization includes page-faults, unless -w is given */
+		double t_first = now_ms ();
+		clv_convolve (clv, inp, out, n_in, n_out, block_size, 1.f);
+		t_first = now_ms () - t_first;
+
+		for (n = 0; n < 8; ++n) { // warm up
+			clv_convolve (clv, inp, out, n_in, n_out, block_size, 1.f);
+		}
+
+		const double t_proc = now_ms ();
+		double t_elapsed = 0;
+		for (n = 0; n < n_blocks && t_elapsed < t_max; ++n) {
+			clv_convolve (clv, inp, out, n_in, n_out, block_size, 1.f);
+			t_elapsed = now_ms () - t_proc;
+		}
+
+		const double n_samples = (double) n * block_size;
+		printf ("%8u %6u %2ux%u  %4.2f %9.1f %10.1f %7.1f%% %8.1f %9ld\n",
+				ir_len, block_size, n_in, n_out, density,
+				t_init,
+				1e6 * t_elapsed / n_samples,
+				100. * t_elapsed / (1e3 * n_samples / rate),
+				t_first * n / t_elapsed,
+				peak_rss_kb ());
+	}
+	rv = 0;
+
+errout:
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (inp[c]);
+		free (out[c]);
+	}
+	clv_free (clv);
+	return rv;
+}
+
+typedef struct {
+	LV2convolv *clv;
+	const char *ir_fn;
+	unsigned int rate;
+	unsigned int block_size;
+	double t_init; ///< ms
+	int rv;
+} RestoreJob;
+
+static void *restore_thread (void *arg) {
+	RestoreJob *job = (RestoreJob*) arg;
+	const double t0 = now_ms ();
+	job->rv = clv_initialize (job->clv, job->rate, 2, 2, job->block_size);
+	job->t_init = now_ms () - t0;
+	return NULL;
+}
+
+/** initialize n_inst 2x2 instances, each with its own IR file, from n_inst threads at once */
+static int restore (unsigned int n_inst, unsigned int ir_len, unsigned int block_size, unsigned int rate, const char *tmpdir) {
+	RestoreJob *jobs = (RestoreJob*) calloc (n_inst, sizeof (RestoreJob));
+	pthread_t *threads = (pthread_t*) calloc (n_inst, sizeof (pthread_t));
+	char (*ir_fn)[1024] = (char (*)[1024]) calloc (n_inst, 1024);
+	unsigned int i, n_started = 0;
+	int rv = -1;
+
+	if (!jobs || !threads || !ir_fn) {
+		goto errout;
+	}
+
+	for (i = 0; i < n_inst; ++i) {
+		snprintf (ir_fn[i], 1024, "%s/convoLV2-bench-%d-r%u.wav", tmpdir, (int) getpid (), i);
+		if (write_ir (ir_fn[i], 4, ir_len, rate)) {
+			goto errout;
+		}
+		if (!(jobs[i].clv = clv_alloc ())) {
+			goto errout;
+		}
+		clv_configure (jobs[i].clv, "convolution.ir.file", ir_fn[i]);
+		clv_configure (jobs[i].clv, "convolution.engine", engine);
+		jobs[i].ir_fn = ir_fn[i];
+		jobs[i].rate = rate;
+		jobs[i].block_size = block_size;
+	}
+
+	{
+		const double t0 = now_ms ();
+		for (n_started = 0; n_started < n_inst; ++n_started) {
+			if (pthread_create (&threads[n_started], NULL, restore_thread, &jobs[n_started])) {
+				break;
+			}
+		}
+		for (i = 0; i < n_started; ++i) {
+			pthread_join (threads[i], NULL);
+		}
+		const double t_wall = now_ms () - t0;
+
+		double t_sum = 0, t_max = 0;
+		rv = n_started == n_inst ? 0 : -1;
+		for (i = 0; i < n_started; ++i) {
+			t_sum += jobs[i].t_init;
+			t_max = fmax (t_max, jobs[i].t_init);
+			if (jobs[i].rv) {
+				rv = -1;
+			}
+		}
+		printf ("# engine: %s, %u instances 2x2, IR %u samples, block-size %u\n", engine, n_inst, ir_len, block_size);
+		printf ("restore: %.1f ms, per instance: %.1f ms average, %.1f ms max%s\n",
+				t_wall, n_started > 0 ? t_sum / n_started : 0, t_max, rv ? " (failed)" : "");
+	}
+
+errout:
+	for (i = 0; jobs && ir_fn && i < n_inst; ++i) {
+		clv_free (jobs[i].clv);
+		if (ir_fn[i][0]) {
+			unlink (ir_fn[i]);
+		}
+	}
+	free (ir_fn);
+	free (threads);
+	free (jobs);
+	return rv;
+}
+
+static void usage (void) {
+	printf ("convoLV2-bench - offline benchmark of the convolution engine\n\n"
+			"Usage: convoLV2-bench [-c] [-d seconds] [-e engine] [-p instances] [-r rate] [-q] [-w] [-y]\n\n"
+			"  -c         compact IR spectra beyond 8192 samples (native engine)\n"
+			"  -d <sec>   audio processed per configuration (default 1.0)\n"
+			"  -e <name>  convolution engine: zita, native (default zita)\n"
+			"  -p <n>     restore: initialize n instances (4 s IR) concurrently and exit\n"
+			"  -r <rate>  sample-rate (default 48000)\n"
+			"  -q         quick run: fewer IR lengths and block-sizes\n"
+			"  -w         warm up the engine after initialization (included in init time)\n"
+			"  -y         hybrid processing, calibrated FIR head\n\n"
+			"Columns: IR length [samples], block-size, inputs x outputs, density,\n"
+			"initialization time [ms], processing time [ns/sample], DSP load,\n"
+			"time of the first period relative to the average period,\n"
+			"peak resident set size of the process [kB].\n");
+}
+
+int main (int argc, char **argv) {
+	static const float ir_sec[] = { 0.1f, 1.f, 4.f };
+	static const unsigned int layout[][2] = { { 1, 1 }, { 1, 2 }, { 2, 2 }, { 4, 4 } };
+	static const float densities[] = { 0.f, 1.f };
+
+	double seconds = 1.0;
+	unsigned int rate = 48000;
+	int quick = 0;
+	unsigned int n_restore = 0;
+	int o;
+
+	while ((o = getopt (argc, argv, "cd:e:hp:qr:wy")) != -1) {
+		switch (o) {
+			case 'c':
+				compact = 1;
+				break;
+			case 'd':
+				seconds = atof (optarg);
+				break;
+			case 'e':
+				engine = optarg;
+				break;
+			case 'p':
+				n_restore = atoi (optarg);
+				break;
+			case 'r':
+				rate = atoi (optarg);
+				break;
+			case 'q':
+				quick = 1;
+				break;
+			case 'w':
+				warmup = 1;
+				break;
+			case 'y':
+				hybrid = 1;
+				break;
+			case 'h':
+				usage ();
+				return 0;
+			default:
+				usage ();
+				return 1;
+		}
+	}
+	if (seconds <= 0 || rate < 8000 || rate > 384000
+			|| (strcmp (engine, "zita") && strcmp (engine, "native"))) {
+		usage ();
+		return 1;
+	}
+
+	const char *tmpdir = getenv ("TMPDIR");
+	if (!tmpdir || !*tmpdir) {
+		tmpdir = "/tmp";
+	}
+
+	srand (42);
+	if (n_restore > 0) {
+		return restore (n_restore, 4 * rate, 256, rate, tmpdir) ? 1 : 0;
+	}
+
+	printf ("# engine: %s%s%s%s\n", engine, hybrid ? ", hybrid" : "", compact ? ", compact" : "", warmup ? ", warm-up" : "");
+	printf ("#  IR-len  block  i/o  dens   init/ms  ns/sample     load  1st/avg   rss/kB\n");
+
+	int rv = 0;
+	for (unsigned int l = 0; l < sizeof (ir_sec) / sizeof (float); ++l) {
+		if (quick && l == 2) {
+			break;
+		}
+		const unsigned int ir_len = ir_sec[l] * rate;
+
+		for (unsigned int k = 0; k < sizeof (layout) / sizeof (layout[0]); ++k) {
+			const unsigned int n_in = layout[k][0];
+			const unsigned int n_out = layout[k][1];
+
+			/* one IR channel per route */
+			char ir_fn[1024];
+			snprintf (ir_fn, sizeof (ir_fn), "%s/convoLV2-bench-%d-%u.wav", tmpdir, (int) getpid (), k);
+			if (write_ir (ir_fn, n_in * n_out, ir_len, rate)) {
+				unlink (ir_fn);
+				return 1;
+			}
+
+			for (unsigned int bs = 64; bs <= 8192; bs *= quick ? 4 : 2) {
+				for (unsigned int d = 0; d < sizeof (densities) / sizeof (float); ++d) {
+					if (d > 0 && n_in * n_out == 1) {
+						continue; // density is irrelevant for a single route
+					}
+					if (bench (ir_fn, ir_len, bs, n_in, n_out, densities[d], seconds, rate)) {
+						rv = 1;
+					}
+				}
+			}
+			unlink (ir_fn);
+		}
+	}
+	return rv;
+}
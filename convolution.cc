@@ -39,10 +39,20 @@
 #include <math.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <dirent.h>
+#endif
 #include <pthread.h>
+#include <sched.h>
 #include <assert.h>
 
 #include <zita-convolver.h>
+#include <fftw3.h>
 #include <sndfile.h>
 #include <samplerate.h>
 #include "convolution.h"
@@ -57,523 +67,4450 @@
 
 static pthread_mutex_t fftw_planner_lock = PTHREAD_MUTEX_INITIALIZER;
 
-struct LV2convolv {
-	Convproc *convproc;
+/** decoded, resampled and gain-scaled IR channel,
+ * shared by all plugin instances in the process */
+typedef struct IRCacheEntry {
+	struct IRCacheEntry *next;
 
-	/* IR file */
-	char *ir_fn; ///< path to IR file
-	unsigned int chn_inp[MAX_CHANNEL_MAPS]; ///< I/O channel map: ir_map[id] = in-channel ;
-	unsigned int chn_out[MAX_CHANNEL_MAPS]; ///< I/O channel map: ir_map[id] = out-channel ;
-	unsigned int ir_chan[MAX_CHANNEL_MAPS]; ///< IR channel map: ir_chan[id] = file-channel;
-	unsigned int ir_delay[MAX_CHANNEL_MAPS]; ///< pre-delay ; value >=0
-	float ir_gain[MAX_CHANNEL_MAPS]; ///< IR-gain value: float -inf..+inf
+	/* key */
+	char *path;
+	time_t mtime;
+	unsigned int rate;
+	unsigned int chan; ///< file-channel (1-based)
+	float gain;
+	unsigned int delay;
 
-	/* convolution settings*/
-	unsigned int size; ///< max length of convolution computation
-	float density; ///< density; 0<= dens <= 1.0 ; '0' = auto (1.0 / min(inchn,outchn)
+	/* data */
+	unsigned int n_chan; ///< channel count of the IR file
+	unsigned int n_frames; ///< length of data (after resampling)
+	float *data;
 
-	/* process settings */
-	unsigned int fragment_size; ///< process period-size
-};
+	unsigned int refcnt;
+} IRCacheEntry;
 
+/** IR data of all routes for one program */
+typedef struct {
+	IRCacheEntry *ir_data[MAX_CHANNEL_MAPS]; ///< IR data in use (reference counted)
+	unsigned int ir_offset[MAX_CHANNEL_MAPS]; ///< first non-zero sample of the IR data
+	unsigned int ir_length[MAX_CHANNEL_MAPS]; ///< used IR samples from ir_offset
+} IRProgram;
 
-/** read an audio-file completely into memory
- * allocated memory needs to be free()ed by caller
+static IRCacheEntry *ir_cache = NULL;
+static pthread_mutex_t ir_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* DSP kernels
+ *
+ * copy_input:  dst[i] = src[i] + offset
+ *   the offset (1e-20) prevents denormals. With FTZ/DAZ enabled it is 0,
+ *   and the addition flushes denormal input to zero.
+ * copy_output: dst[i] = src[i] * (gain + i * gain_step)
+ *   output gain with a per-sample linear ramp
+ * mix_output:  dst[i] += src[i] * (gain + i * gain_step)
+ * cmac:        acc[i] += x[i] * h[i], complex, split real/imaginary arrays
+ *   spectral multiply-accumulate of the native engine
+ * cmac_q16:    cmac with h[i] = q[i] * scale[i / CLV_Q16_BLOCK]
+ *   compact IR partitions, block-scaled int16. n_bins is a multiple of CLV_Q16_BLOCK
+ * fir:         y[i] += sum_k h[k] * x[i - k]
+ *   direct-form FIR of the hybrid head, x[-(n_taps - 1)] must be valid
+ * peak:        max |src[i]|, input silence detection
+ *
+ * x86 variants are compiled for SSE2, AVX2 and AVX-512 regardless of the
+ * build flags. The first supported entry of dsp_kernels[] is used,
+ * unless overridden with the CONVOLV2_SIMD environment variable.
  */
-static int audiofile_read (const char *fn, const int sample_rate, float **buf, unsigned int *n_ch, unsigned int *n_sp) {
-	SF_INFO nfo;
-	SNDFILE  *sndfile;
-	float resample_ratio = 1.0;
 
-	memset(&nfo, 0, sizeof(SF_INFO));
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define CLV_X86_DISPATCH
+# include <immintrin.h>
+#endif
 
-	if ((sndfile = sf_open(fn, SFM_READ, &nfo)) == 0) {
-		return -1;
+#define CLV_Q16_BLOCK 16 ///< bins per scale factor of compact IR spectra
+
+typedef struct {
+	const char *name;
+	int (*supported) (void);
+	void (*copy_input) (float *dst, const float *src, const unsigned int n_samples, const float offset);
+	void (*copy_output) (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step);
+	void (*mix_output) (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step);
+	void (*cmac) (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, const unsigned int n_bins);
+	void (*cmac_q16) (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const int16_t *q_re, const int16_t *q_im, const float *scale, const unsigned int n_bins);
+	void (*fir) (float *y, const float *x, const float *h, const unsigned int n_taps, const unsigned int n_samples);
+	float (*peak) (const float *src, const unsigned int n_samples);
+} DSPKernels;
+
+static int supported_c (void) {
+	return 1;
+}
+
+static void copy_input_c (float *dst, const float *src, const unsigned int n_samples, const float offset) {
+	unsigned int i;
+	for (i = 0; i < n_samples; ++i) {
+		dst[i] = src[i] + offset;
 	}
+}
 
-	if (n_ch) *n_ch = (unsigned int) nfo.channels;
-	if (n_sp) *n_sp = (unsigned int) nfo.frames;
+static void copy_output_c (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	unsigned int i;
+	if (gain == 1.f && gain_step == 0.f) {
+		memcpy (dst, src, n_samples * sizeof (float));
+		return;
+	}
+	for (i = 0; i < n_samples; ++i) {
+		dst[i] = src[i] * (gain + i * gain_step);
+	}
+}
 
-	if (sample_rate != nfo.samplerate) {
-		fprintf(stderr, "convoLV2: samplerate mismatch file:%d host:%d\n", nfo.samplerate, sample_rate);
-		resample_ratio = (float) sample_rate / (float) nfo.samplerate;
+static void mix_output_c (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	unsigned int i;
+	for (i = 0; i < n_samples; ++i) {
+		dst[i] += src[i] * (gain + i * gain_step);
 	}
+}
 
-	if (buf) {
-		const size_t frames_in = nfo.channels * nfo.frames;
-		const size_t frames_out = nfo.channels * ceil(nfo.frames * resample_ratio);
-		sf_count_t rd;
-		float *rdb;
-		*buf = (float*) malloc(frames_out*sizeof(float));
+static void cmac_c (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, const unsigned int n_bins) {
+	unsigned int i;
+	for (i = 0; i < n_bins; ++i) {
+		acc_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+		acc_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+	}
+}
 
-		if (!*buf) {
-			fprintf (stderr, "convoLV2: memory allocation failed for IR audio-file buffer.\n");
-			sf_close (sndfile);
-			return (-2);
-		}
+static void cmac_q16_c (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const int16_t *q_re, const int16_t *q_im, const float *scale, const unsigned int n_bins) {
+	unsigned int i;
+	for (i = 0; i < n_bins; ++i) {
+		const float s = scale[i / CLV_Q16_BLOCK];
+		const float h_re = q_re[i] * s;
+		const float h_im = q_im[i] * s;
+		acc_re[i] += x_re[i] * h_re - x_im[i] * h_im;
+		acc_im[i] += x_re[i] * h_im + x_im[i] * h_re;
+	}
+}
 
-		if (resample_ratio == 1.0) {
-			rdb = *buf;
-		} else {
-			rdb = (float*) malloc(frames_in*sizeof(float));
-			if (!rdb) {
-				fprintf (stderr, "convoLV2: memory allocation failed for IR resample buffer.\n");
-				sf_close (sndfile);
-				free(*buf);
-				return -1;
-			}
+static void fir_c (float *y, const float *x, const float *h, const unsigned int n_taps, const unsigned int n_samples) {
+	unsigned int i, k;
+	for (i = 0; i < n_samples; ++i) {
+		const float *xi = x + i;
+		float acc = 0.f;
+		for (k = 0; k < n_taps; ++k) {
+			acc += h[k] * *(xi - k);
 		}
+		y[i] += acc;
+	}
+}
 
-		if(nfo.frames != (rd=sf_readf_float(sndfile, rdb, nfo.frames))) {
-			fprintf(stderr, "convoLV2: IR short read %ld of %ld\n", (long int) rd, (long int) nfo.frames);
-			free(*buf);
-			if (resample_ratio != 1.0) {
-				free(rdb);
-			}
-			sf_close (sndfile);
-			return -3;
+static float peak_c (const float *src, const unsigned int n_samples) {
+	unsigned int i;
+	float pk = 0.f;
+	for (i = 0; i < n_samples; ++i) {
+		const float a = fabsf (src[i]);
+		if (a > pk) {
+			pk = a;
 		}
+	}
+	return pk;
+}
 
-		if (resample_ratio != 1.0) {
-			VERBOSE_printf("convoLV2: resampling IR %ld -> %ld [frames * channels].\n",
-					(long int) frames_in,
-					(long int) frames_out);
-			SRC_STATE* src_state = src_new(SRC_QUALITY, nfo.channels, NULL);
-			SRC_DATA src_data;
-
-			src_data.input_frames  = nfo.frames;
-			src_data.output_frames = nfo.frames * resample_ratio;
-			src_data.end_of_input  = 1;
-			src_data.src_ratio     = resample_ratio;
-			src_data.input_frames_used = 0;
-			src_data.output_frames_gen = 0;
-			src_data.data_in       = rdb;
-			src_data.data_out      = *buf;
-			src_process(src_state, &src_data);
-			VERBOSE_printf("convoLV2: resampled IR  %ld -> %ld [frames * channels].\n",
-					src_data.input_frames_used * nfo.channels,
-					src_data.output_frames_gen * nfo.channels);
+#ifdef CLV_X86_DISPATCH
+static int supported_sse2 (void) {
+	return __builtin_cpu_supports ("sse2");
+}
 
-			if (n_sp) *n_sp = (unsigned int) src_data.output_frames_gen;
-			free(rdb);
-			src_delete  (src_state);
-		}
-	}
+static int supported_avx2 (void) {
+	return __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+}
 
-	sf_close (sndfile);
-	return (0);
+static int supported_avx512 (void) {
+	return __builtin_cpu_supports ("avx512f");
 }
 
-LV2convolv *clv_alloc() {
-	int i;
-	LV2convolv *clv = (LV2convolv*) calloc(1, sizeof(LV2convolv));
-	if (!clv) {
-		return NULL;
+__attribute__((target("sse2")))
+static void copy_input_sse2 (float *dst, const float *src, const unsigned int n_samples, const float offset) {
+	const __m128 o = _mm_set1_ps (offset);
+	unsigned int i = 0;
+	for (; i + 4 <= n_samples; i += 4) {
+		_mm_storeu_ps (dst + i, _mm_add_ps (_mm_loadu_ps (src + i), o));
 	}
-
-	clv->convproc = NULL;
-	for (i = 0; i < MAX_CHANNEL_MAPS; ++i) {
-		clv->ir_chan[i]  = i + 1;
-		clv->chn_inp[i]  = i + 1;
-		clv->chn_out[i]  = i + 1;
-		clv->ir_delay[i] = 0;
-		clv->ir_gain[i]  = 0.5f;
+	for (; i < n_samples; ++i) {
+		dst[i] = src[i] + offset;
 	}
-	clv->ir_fn = NULL;
-	clv->density = 0.f;
-	clv->size = 0x00100000;
-	return clv;
 }
 
-void clv_release (LV2convolv *clv) {
-	if (!clv) return;
-	if (clv->convproc) {
-		clv->convproc->stop_process ();
-		delete (clv->convproc);
+__attribute__((target("sse2")))
+static void copy_output_sse2 (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	const __m128 g = _mm_set1_ps (gain);
+	const __m128 dg = _mm_set1_ps (gain_step);
+	__m128 idx = _mm_setr_ps (0.f, 1.f, 2.f, 3.f);
+	const __m128 inc = _mm_set1_ps (4.f);
+	unsigned int i = 0;
+	for (; i + 4 <= n_samples; i += 4) {
+		const __m128 gi = _mm_add_ps (g, _mm_mul_ps (idx, dg));
+		_mm_storeu_ps (dst + i, _mm_mul_ps (_mm_loadu_ps (src + i), gi));
+		idx = _mm_add_ps (idx, inc);
+	}
+	for (; i < n_samples; ++i) {
+		dst[i] = src[i] * (gain + i * gain_step);
 	}
-	clv->convproc = NULL;
 }
 
-void clv_clone_settings(LV2convolv *clv_new, LV2convolv *clv) {
-	if (!clv) return;
-	memcpy (clv_new, clv, sizeof(LV2convolv));
-	clv_new->convproc = NULL;
-	if (clv->ir_fn) {
-		clv_new->ir_fn = strdup (clv->ir_fn);
+__attribute__((target("sse2")))
+static void mix_output_sse2 (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	const __m128 g = _mm_set1_ps (gain);
+	const __m128 dg = _mm_set1_ps (gain_step);
+	__m128 idx = _mm_setr_ps (0.f, 1.f, 2.f, 3.f);
+	const __m128 inc = _mm_set1_ps (4.f);
+	unsigned int i = 0;
+	for (; i + 4 <= n_samples; i += 4) {
+		const __m128 gi = _mm_add_ps (g, _mm_mul_ps (idx, dg));
+		_mm_storeu_ps (dst + i, _mm_add_ps (_mm_loadu_ps (dst + i), _mm_mul_ps (_mm_loadu_ps (src + i), gi)));
+		idx = _mm_add_ps (idx, inc);
+	}
+	for (; i < n_samples; ++i) {
+		dst[i] += src[i] * (gain + i * gain_step);
 	}
 }
 
-void clv_free (LV2convolv *clv) {
-	if (!clv) return;
-	clv_release (clv);
-	free (clv->ir_fn);
-	free (clv);
+__attribute__((target("sse2")))
+static void cmac_sse2 (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, const unsigned int n_bins) {
+	unsigned int i = 0;
+	for (; i + 4 <= n_bins; i += 4) {
+		const __m128 xr = _mm_loadu_ps (x_re + i);
+		const __m128 xi = _mm_loadu_ps (x_im + i);
+		const __m128 hr = _mm_loadu_ps (h_re + i);
+		const __m128 hi = _mm_loadu_ps (h_im + i);
+		_mm_storeu_ps (acc_re + i, _mm_add_ps (_mm_loadu_ps (acc_re + i), _mm_sub_ps (_mm_mul_ps (xr, hr), _mm_mul_ps (xi, hi))));
+		_mm_storeu_ps (acc_im + i, _mm_add_ps (_mm_loadu_ps (acc_im + i), _mm_add_ps (_mm_mul_ps (xr, hi), _mm_mul_ps (xi, hr))));
+	}
+	for (; i < n_bins; ++i) {
+		acc_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+		acc_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+	}
 }
 
-int clv_configure (LV2convolv *clv, const char *key, const char *value) {
-	if (!clv) return 0;
-	int n;
-	if (strcasecmp (key, "convolution.ir.file") == 0) {
-		free(clv->ir_fn);
-		clv->ir_fn = strdup(value);
-	} else if (!strncasecmp (key, "convolution.out.source.", 23)) {
-		if (sscanf (key, "convolution.source.%d", &n) == 1) {
-			if ((0 < n) && (n <= MAX_CHANNEL_MAPS))
-				clv->chn_inp[n] = atoi(value);
-		}
-	} else if (!strncasecmp (key, "convolution.out.source.", 23)) {
-		if (sscanf (key, "convolution.output.%d", &n) == 1) {
-			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
-				clv->chn_out[n] = atoi(value);
-		}
-	} else if (!strncasecmp (key, "convolution.ir.channel.", 23)) {
-		if (sscanf (key, "convolution.ir.channel.%d", &n) == 1) {
-			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
-				clv->ir_chan[n] = atoi(value);
-		}
-	} else if (!strncasecmp (key, "convolution.ir.gain.", 20)) {
-		if (sscanf (key, "convolution.ir.gain.%d", &n) == 1) {
-			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
-				clv->ir_gain[n] = atof(value);
-		}
-	} else if (!strncasecmp (key, "convolution.ir.delay.", 21)) {
-		if (sscanf (key, "convolution.ir.delay.%d", &n) == 1) {
-			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
-				clv->ir_delay[n] = atoi(value);
-		}
-	} else if (strcasecmp (key, "convolution.maxsize") == 0) {
-		clv->size = atoi(value);
-		if (clv->size > 0x00400000) {
-			clv->size = 0x00400000;
-		}
-		if (clv->size < 0x00001000) {
-			clv->size = 0x00001000;
+__attribute__((target("sse2")))
+static void cmac_q16_sse2 (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const int16_t *q_re, const int16_t *q_im, const float *scale, const unsigned int n_bins) {
+	unsigned int i, k;
+	for (i = 0; i < n_bins; i += CLV_Q16_BLOCK) {
+		const __m128 s = _mm_set1_ps (scale[i / CLV_Q16_BLOCK]);
+		for (k = i; k < i + CLV_Q16_BLOCK; k += 8) {
+			const __m128i qr = _mm_loadu_si128 ((const __m128i*) (q_re + k));
+			const __m128i qi = _mm_loadu_si128 ((const __m128i*) (q_im + k));
+			/* sign-extend: int16 in the upper half of each int32, shifted down */
+			const __m128 hr[2] = {
+				_mm_mul_ps (s, _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (qr, qr), 16))),
+				_mm_mul_ps (s, _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (qr, qr), 16)))
+			};
+			const __m128 hi[2] = {
+				_mm_mul_ps (s, _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (qi, qi), 16))),
+				_mm_mul_ps (s, _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (qi, qi), 16)))
+			};
+			for (unsigned int j = 0; j < 2; ++j) {
+				const __m128 xr = _mm_loadu_ps (x_re + k + 4 * j);
+				const __m128 xi = _mm_loadu_ps (x_im + k + 4 * j);
+				_mm_storeu_ps (acc_re + k + 4 * j, _mm_add_ps (_mm_loadu_ps (acc_re + k + 4 * j), _mm_sub_ps (_mm_mul_ps (xr, hr[j]), _mm_mul_ps (xi, hi[j]))));
+				_mm_storeu_ps (acc_im + k + 4 * j, _mm_add_ps (_mm_loadu_ps (acc_im + k + 4 * j), _mm_add_ps (_mm_mul_ps (xr, hi[j]), _mm_mul_ps (xi, hr[j]))));
+			}
 		}
-	} else {
-		return 0;
 	}
-	return 1; // OK
 }
 
-char *clv_dump_settings (LV2convolv *clv) {
-	if (!clv) return NULL;
-
-#define MAX_CFG_SIZE ( MAX_CHANNEL_MAPS * 160 + 60 + (clv->ir_fn ? strlen(clv->ir_fn) : 0) )
-	int i;
-	size_t off = 0;
-	char *rv = (char*) malloc (MAX_CFG_SIZE * sizeof (char));
-#undef MAX_CFG_SIZE
-
-	for (i = 0; i < MAX_CHANNEL_MAPS; ++i) {
-		// f=12 ; d= 3 ; v=10
-		off+= sprintf (rv + off, "convolution.ir.gain.%d=%e\n",    i, clv->ir_gain[i]); // 22 + d + f
-		off+= sprintf (rv + off, "convolution.ir.delay.%d=%d\n",   i, clv->ir_delay[i]);// 23 + d + v
-		off+= sprintf (rv + off, "convolution.ir.channel.%d=%d\n", i, clv->ir_chan[i]); // 25 + d + d
-		off+= sprintf (rv + off, "convolution.source.%d=%d\n",     i, clv->chn_inp[i]); // 21 + d + d
-		off+= sprintf (rv + off, "convolution.output.%d=%d\n",     i, clv->chn_out[i]); // 21 + d + d
+__attribute__((target("sse2")))
+static void fir_sse2 (float *y, const float *x, const float *h, const unsigned int n_taps, const unsigned int n_samples) {
+	unsigned int i = 0, k;
+	/* taps in the inner loop, 16 outputs in registers */
+	for (; i + 16 <= n_samples; i += 16) {
+		__m128 a0 = _mm_setzero_ps ();
+		__m128 a1 = _mm_setzero_ps ();
+		__m128 a2 = _mm_setzero_ps ();
+		__m128 a3 = _mm_setzero_ps ();
+		for (k = 0; k < n_taps; ++k) {
+			const __m128 hk = _mm_set1_ps (h[k]);
+			const float *xp = x + i - k;
+			a0 = _mm_add_ps (a0, _mm_mul_ps (hk, _mm_loadu_ps (xp)));
+			a1 = _mm_add_ps (a1, _mm_mul_ps (hk, _mm_loadu_ps (xp + 4)));
+			a2 = _mm_add_ps (a2, _mm_mul_ps (hk, _mm_loadu_ps (xp + 8)));
+			a3 = _mm_add_ps (a3, _mm_mul_ps (hk, _mm_loadu_ps (xp + 12)));
+		}
+		_mm_storeu_ps (y + i,      _mm_add_ps (_mm_loadu_ps (y + i), a0));
+		_mm_storeu_ps (y + i + 4,  _mm_add_ps (_mm_loadu_ps (y + i + 4), a1));
+		_mm_storeu_ps (y + i + 8,  _mm_add_ps (_mm_loadu_ps (y + i + 8), a2));
+		_mm_storeu_ps (y + i + 12, _mm_add_ps (_mm_loadu_ps (y + i + 12), a3));
+	}
+	if (i < n_samples) {
+		fir_c (y + i, x + i, h, n_taps, n_samples - i);
 	}
-	off+= sprintf(rv + off, "convolution.maxsize=%u\n", clv->size);                         // 21 + v
-	return rv;
 }
 
-int clv_query_setting (LV2convolv *clv, const char *key, char *value, size_t val_max_len) {
-	int rv = 0;
-	if (!clv || !value || !key) {
-		return -1;
+__attribute__((target("sse2")))
+static float peak_sse2 (const float *src, const unsigned int n_samples) {
+	const __m128 mask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+	__m128 pk = _mm_setzero_ps ();
+	unsigned int i = 0;
+	for (; i + 4 <= n_samples; i += 4) {
+		pk = _mm_max_ps (pk, _mm_and_ps (mask, _mm_loadu_ps (src + i)));
 	}
-
-	if (strcasecmp (key, "convolution.ir.file") == 0) {
-		if (clv->ir_fn) {
-			if (strlen(clv->ir_fn) >= val_max_len) {
-				rv = -1;
-			}
-			else {
-				rv=snprintf(value, val_max_len, "%s", clv->ir_fn);
-			}
-		}
+	pk = _mm_max_ps (pk, _mm_movehl_ps (pk, pk));
+	pk = _mm_max_ss (pk, _mm_shuffle_ps (pk, pk, 1));
+	const float rv = _mm_cvtss_f32 (pk);
+	if (i < n_samples) {
+		const float t = peak_c (src + i, n_samples - i);
+		return t > rv ? t : rv;
 	}
-	// TODO allow querying other settings
 	return rv;
 }
 
-
-int clv_initialize (
-		LV2convolv *clv,
-		const unsigned int sample_rate,
-		const unsigned int in_channel_cnt,
-		const unsigned int out_channel_cnt,
-		const unsigned int buffersize)
-{
-	unsigned int c;
-	const unsigned int n_elem = in_channel_cnt * out_channel_cnt;
-
-	/* zita-conv settings */
-	const unsigned int options = 0;
-
-	/* IR file */
-	unsigned int n_chan = 0;
-	unsigned int n_frames = 0;
-	unsigned int max_size = 0;
-
-	float *p = NULL;  /* temp. IR file buffer */
-	float *gb = NULL; /* temp. gain-scaled IR file buffer */
-
-	clv->fragment_size = buffersize;
-
-	if (clv->convproc) {
-		fprintf (stderr, "convoLV2: already initialized.\n");
-		return (-1);
+__attribute__((target("avx2,fma")))
+static void copy_input_avx2 (float *dst, const float *src, const unsigned int n_samples, const float offset) {
+	const __m256 o = _mm256_set1_ps (offset);
+	unsigned int i = 0;
+	for (; i + 8 <= n_samples; i += 8) {
+		_mm256_storeu_ps (dst + i, _mm256_add_ps (_mm256_loadu_ps (src + i), o));
 	}
-
-	if (!clv->ir_fn) {
-		fprintf (stderr, "convoLV2: No IR file was configured.\n");
-		return -1;
+	for (; i < n_samples; ++i) {
+		dst[i] = src[i] + offset;
 	}
+}
 
-	if (access(clv->ir_fn, R_OK) != 0) {
-		fprintf(stderr, "convoLV2: cannot stat IR: %s\n", clv->ir_fn);
-		return -1;
+__attribute__((target("avx2,fma")))
+static void copy_output_avx2 (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	const __m256 g = _mm256_set1_ps (gain);
+	const __m256 dg = _mm256_set1_ps (gain_step);
+	__m256 idx = _mm256_setr_ps (0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+	const __m256 inc = _mm256_set1_ps (8.f);
+	unsigned int i = 0;
+	for (; i + 8 <= n_samples; i += 8) {
+		const __m256 gi = _mm256_fmadd_ps (idx, dg, g);
+		_mm256_storeu_ps (dst + i, _mm256_mul_ps (_mm256_loadu_ps (src + i), gi));
+		idx = _mm256_add_ps (idx, inc);
 	}
+	for (; i < n_samples; ++i) {
+		dst[i] = src[i] * (gain + i * gain_step);
+	}
+}
 
-	pthread_mutex_lock(&fftw_planner_lock);
-
-	clv->convproc = new Convproc;
-	clv->convproc->set_options (options);
-#if ZITA_CONVOLVER_MAJOR_VERSION == 3
-	clv->convproc->set_density (clv->density);
-#endif
-
-	if (audiofile_read (clv->ir_fn, sample_rate, &p, &n_chan, &n_frames)) {
-		fprintf(stderr, "convoLV2: failed to read IR.\n");
-		goto errout;
+__attribute__((target("avx2,fma")))
+static void mix_output_avx2 (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	const __m256 g = _mm256_set1_ps (gain);
+	const __m256 dg = _mm256_set1_ps (gain_step);
+	__m256 idx = _mm256_setr_ps (0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+	const __m256 inc = _mm256_set1_ps (8.f);
+	unsigned int i = 0;
+	for (; i + 8 <= n_samples; i += 8) {
+		const __m256 gi = _mm256_fmadd_ps (idx, dg, g);
+		_mm256_storeu_ps (dst + i, _mm256_fmadd_ps (_mm256_loadu_ps (src + i), gi, _mm256_loadu_ps (dst + i)));
+		idx = _mm256_add_ps (idx, inc);
+	}
+	for (; i < n_samples; ++i) {
+		dst[i] += src[i] * (gain + i * gain_step);
 	}
+}
 
-	if (n_frames == 0 || n_chan == 0) {
-		fprintf(stderr, "convoLV2: invalid IR file.\n");
-		goto errout;
+__attribute__((target("avx2,fma")))
+static void cmac_avx2 (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, const unsigned int n_bins) {
+	unsigned int i = 0;
+	for (; i + 8 <= n_bins; i += 8) {
+		const __m256 xr = _mm256_loadu_ps (x_re + i);
+		const __m256 xi = _mm256_loadu_ps (x_im + i);
+		const __m256 hr = _mm256_loadu_ps (h_re + i);
+		const __m256 hi = _mm256_loadu_ps (h_im + i);
+		_mm256_storeu_ps (acc_re + i, _mm256_fnmadd_ps (xi, hi, _mm256_fmadd_ps (xr, hr, _mm256_loadu_ps (acc_re + i))));
+		_mm256_storeu_ps (acc_im + i, _mm256_fmadd_ps (xi, hr, _mm256_fmadd_ps (xr, hi, _mm256_loadu_ps (acc_im + i))));
 	}
+	for (; i < n_bins; ++i) {
+		acc_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+		acc_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+	}
+}
 
-	for (c = 0; c < MAX_CHANNEL_MAPS; c++) {
-		// TODO only relevant channels
-		if (clv->ir_delay[c] > max_size) {
-			max_size = clv->ir_delay[c];
+__attribute__((target("avx2,fma")))
+static void cmac_q16_avx2 (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const int16_t *q_re, const int16_t *q_im, const float *scale, const unsigned int n_bins) {
+	unsigned int i, k;
+	for (i = 0; i < n_bins; i += CLV_Q16_BLOCK) {
+		const __m256 s = _mm256_set1_ps (scale[i / CLV_Q16_BLOCK]);
+		for (k = i; k < i + CLV_Q16_BLOCK; k += 8) {
+			const __m256 hr = _mm256_mul_ps (s, _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i*) (q_re + k)))));
+			const __m256 hi = _mm256_mul_ps (s, _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 ((const __m128i*) (q_im + k)))));
+			const __m256 xr = _mm256_loadu_ps (x_re + k);
+			const __m256 xi = _mm256_loadu_ps (x_im + k);
+			_mm256_storeu_ps (acc_re + k, _mm256_fnmadd_ps (xi, hi, _mm256_fmadd_ps (xr, hr, _mm256_loadu_ps (acc_re + k))));
+			_mm256_storeu_ps (acc_im + k, _mm256_fmadd_ps (xi, hr, _mm256_fmadd_ps (xr, hi, _mm256_loadu_ps (acc_im + k))));
 		}
 	}
+}
 
-	max_size += n_frames;
-
+__attribute__((target("avx2,fma")))
+static void fir_avx2 (float *y, const float *x, const float *h, const unsigned int n_taps, const unsigned int n_samples) {
+	unsigned int i = 0, k;
+	for (; i + 32 <= n_samples; i += 32) {
+		__m256 a0 = _mm256_setzero_ps ();
+		__m256 a1 = _mm256_setzero_ps ();
+		__m256 a2 = _mm256_setzero_ps ();
+		__m256 a3 = _mm256_setzero_ps ();
+		for (k = 0; k < n_taps; ++k) {
+			const __m256 hk = _mm256_broadcast_ss (h + k);
+			const float *xp = x + i - k;
+			a0 = _mm256_fmadd_ps (hk, _mm256_loadu_ps (xp), a0);
+			a1 = _mm256_fmadd_ps (hk, _mm256_loadu_ps (xp + 8), a1);
+			a2 = _mm256_fmadd_ps (hk, _mm256_loadu_ps (xp + 16), a2);
+			a3 = _mm256_fmadd_ps (hk, _mm256_loadu_ps (xp + 24), a3);
+		}
+		_mm256_storeu_ps (y + i,      _mm256_add_ps (_mm256_loadu_ps (y + i), a0));
+		_mm256_storeu_ps (y + i + 8,  _mm256_add_ps (_mm256_loadu_ps (y + i + 8), a1));
+		_mm256_storeu_ps (y + i + 16, _mm256_add_ps (_mm256_loadu_ps (y + i + 16), a2));
+		_mm256_storeu_ps (y + i + 24, _mm256_add_ps (_mm256_loadu_ps (y + i + 24), a3));
+	}
+	for (; i + 8 <= n_samples; i += 8) {
+		__m256 a0 = _mm256_setzero_ps ();
+		for (k = 0; k < n_taps; ++k) {
+			a0 = _mm256_fmadd_ps (_mm256_broadcast_ss (h + k), _mm256_loadu_ps (x + i - k), a0);
+		}
+		_mm256_storeu_ps (y + i, _mm256_add_ps (_mm256_loadu_ps (y + i), a0));
+	}
+	if (i < n_samples) {
+		fir_c (y + i, x + i, h, n_taps, n_samples - i);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static float peak_avx2 (const float *src, const unsigned int n_samples) {
+	const __m256 mask = _mm256_castsi256_ps (_mm256_set1_epi32 (0x7fffffff));
+	__m256 pk = _mm256_setzero_ps ();
+	unsigned int i = 0;
+	for (; i + 8 <= n_samples; i += 8) {
+		pk = _mm256_max_ps (pk, _mm256_and_ps (mask, _mm256_loadu_ps (src + i)));
+	}
+	__m128 p4 = _mm_max_ps (_mm256_castps256_ps128 (pk), _mm256_extractf128_ps (pk, 1));
+	p4 = _mm_max_ps (p4, _mm_movehl_ps (p4, p4));
+	p4 = _mm_max_ss (p4, _mm_shuffle_ps (p4, p4, 1));
+	const float rv = _mm_cvtss_f32 (p4);
+	if (i < n_samples) {
+		const float t = peak_c (src + i, n_samples - i);
+		return t > rv ? t : rv;
+	}
+	return rv;
+}
+
+__attribute__((target("avx512f")))
+static void copy_input_avx512 (float *dst, const float *src, const unsigned int n_samples, const float offset) {
+	const __m512 o = _mm512_set1_ps (offset);
+	unsigned int i = 0;
+	for (; i + 16 <= n_samples; i += 16) {
+		_mm512_storeu_ps (dst + i, _mm512_add_ps (_mm512_loadu_ps (src + i), o));
+	}
+	if (i < n_samples) {
+		const __mmask16 m = (__mmask16) ((1u << (n_samples - i)) - 1);
+		_mm512_mask_storeu_ps (dst + i, m, _mm512_add_ps (_mm512_maskz_loadu_ps (m, src + i), o));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void copy_output_avx512 (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	const __m512 g = _mm512_set1_ps (gain);
+	const __m512 dg = _mm512_set1_ps (gain_step);
+	__m512 idx = _mm512_setr_ps (0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f);
+	const __m512 inc = _mm512_set1_ps (16.f);
+	unsigned int i = 0;
+	for (; i + 16 <= n_samples; i += 16) {
+		const __m512 gi = _mm512_fmadd_ps (idx, dg, g);
+		_mm512_storeu_ps (dst + i, _mm512_mul_ps (_mm512_loadu_ps (src + i), gi));
+		idx = _mm512_add_ps (idx, inc);
+	}
+	if (i < n_samples) {
+		const __mmask16 m = (__mmask16) ((1u << (n_samples - i)) - 1);
+		const __m512 gi = _mm512_fmadd_ps (idx, dg, g);
+		_mm512_mask_storeu_ps (dst + i, m, _mm512_mul_ps (_mm512_maskz_loadu_ps (m, src + i), gi));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void mix_output_avx512 (float *dst, const float *src, const unsigned int n_samples, const float gain, const float gain_step) {
+	const __m512 g = _mm512_set1_ps (gain);
+	const __m512 dg = _mm512_set1_ps (gain_step);
+	__m512 idx = _mm512_setr_ps (0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f);
+	const __m512 inc = _mm512_set1_ps (16.f);
+	unsigned int i = 0;
+	for (; i + 16 <= n_samples; i += 16) {
+		const __m512 gi = _mm512_fmadd_ps (idx, dg, g);
+		_mm512_storeu_ps (dst + i, _mm512_fmadd_ps (_mm512_loadu_ps (src + i), gi, _mm512_loadu_ps (dst + i)));
+		idx = _mm512_add_ps (idx, inc);
+	}
+	if (i < n_samples) {
+		const __mmask16 m = (__mmask16) ((1u << (n_samples - i)) - 1);
+		const __m512 gi = _mm512_fmadd_ps (idx, dg, g);
+		_mm512_mask_storeu_ps (dst + i, m, _mm512_fmadd_ps (_mm512_maskz_loadu_ps (m, src + i), gi, _mm512_maskz_loadu_ps (m, dst + i)));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void cmac_avx512 (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const float *h_re, const float *h_im, const unsigned int n_bins) {
+	unsigned int i = 0;
+	for (; i + 16 <= n_bins; i += 16) {
+		const __m512 xr = _mm512_loadu_ps (x_re + i);
+		const __m512 xi = _mm512_loadu_ps (x_im + i);
+		const __m512 hr = _mm512_loadu_ps (h_re + i);
+		const __m512 hi = _mm512_loadu_ps (h_im + i);
+		_mm512_storeu_ps (acc_re + i, _mm512_fnmadd_ps (xi, hi, _mm512_fmadd_ps (xr, hr, _mm512_loadu_ps (acc_re + i))));
+		_mm512_storeu_ps (acc_im + i, _mm512_fmadd_ps (xi, hr, _mm512_fmadd_ps (xr, hi, _mm512_loadu_ps (acc_im + i))));
+	}
+	if (i < n_bins) {
+		const __mmask16 m = (__mmask16) ((1u << (n_bins - i)) - 1);
+		const __m512 xr = _mm512_maskz_loadu_ps (m, x_re + i);
+		const __m512 xi = _mm512_maskz_loadu_ps (m, x_im + i);
+		const __m512 hr = _mm512_maskz_loadu_ps (m, h_re + i);
+		const __m512 hi = _mm512_maskz_loadu_ps (m, h_im + i);
+		_mm512_mask_storeu_ps (acc_re + i, m, _mm512_fnmadd_ps (xi, hi, _mm512_fmadd_ps (xr, hr, _mm512_maskz_loadu_ps (m, acc_re + i))));
+		_mm512_mask_storeu_ps (acc_im + i, m, _mm512_fmadd_ps (xi, hr, _mm512_fmadd_ps (xr, hi, _mm512_maskz_loadu_ps (m, acc_im + i))));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void cmac_q16_avx512 (float *acc_re, float *acc_im, const float *x_re, const float *x_im, const int16_t *q_re, const int16_t *q_im, const float *scale, const unsigned int n_bins) {
+	unsigned int i;
+	/* the zero-masked conversions are equivalent, but avoid a spurious -Wmaybe-uninitialized (GCC 12) */
+	const __mmask16 m = (__mmask16) 0xffff;
+	for (i = 0; i < n_bins; i += CLV_Q16_BLOCK) {
+		const __m512 s = _mm512_set1_ps (scale[i / CLV_Q16_BLOCK]);
+		const __m512 hr = _mm512_mul_ps (s, _mm512_maskz_cvtepi32_ps (m, _mm512_maskz_cvtepi16_epi32 (m, _mm256_loadu_si256 ((const __m256i*) (q_re + i)))));
+		const __m512 hi = _mm512_mul_ps (s, _mm512_maskz_cvtepi32_ps (m, _mm512_maskz_cvtepi16_epi32 (m, _mm256_loadu_si256 ((const __m256i*) (q_im + i)))));
+		const __m512 xr = _mm512_loadu_ps (x_re + i);
+		const __m512 xi = _mm512_loadu_ps (x_im + i);
+		_mm512_storeu_ps (acc_re + i, _mm512_fnmadd_ps (xi, hi, _mm512_fmadd_ps (xr, hr, _mm512_loadu_ps (acc_re + i))));
+		_mm512_storeu_ps (acc_im + i, _mm512_fmadd_ps (xi, hr, _mm512_fmadd_ps (xr, hi, _mm512_loadu_ps (acc_im + i))));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void fir_avx512 (float *y, const float *x, const float *h, const unsigned int n_taps, const unsigned int n_samples) {
+	unsigned int i = 0, k;
+	for (; i + 64 <= n_samples; i += 64) {
+		__m512 a0 = _mm512_setzero_ps ();
+		__m512 a1 = _mm512_setzero_ps ();
+		__m512 a2 = _mm512_setzero_ps ();
+		__m512 a3 = _mm512_setzero_ps ();
+		for (k = 0; k < n_taps; ++k) {
+			const __m512 hk = _mm512_set1_ps (h[k]);
+			const float *xp = x + i - k;
+			a0 = _mm512_fmadd_ps (hk, _mm512_loadu_ps (xp), a0);
+			a1 = _mm512_fmadd_ps (hk, _mm512_loadu_ps (xp + 16), a1);
+			a2 = _mm512_fmadd_ps (hk, _mm512_loadu_ps (xp + 32), a2);
+			a3 = _mm512_fmadd_ps (hk, _mm512_loadu_ps (xp + 48), a3);
+		}
+		_mm512_storeu_ps (y + i,      _mm512_add_ps (_mm512_loadu_ps (y + i), a0));
+		_mm512_storeu_ps (y + i + 16, _mm512_add_ps (_mm512_loadu_ps (y + i + 16), a1));
+		_mm512_storeu_ps (y + i + 32, _mm512_add_ps (_mm512_loadu_ps (y + i + 32), a2));
+		_mm512_storeu_ps (y + i + 48, _mm512_add_ps (_mm512_loadu_ps (y + i + 48), a3));
+	}
+	for (; i < n_samples; i += 16) {
+		const __mmask16 m = n_samples - i >= 16 ? (__mmask16) 0xffff : (__mmask16) ((1u << (n_samples - i)) - 1);
+		__m512 a0 = _mm512_setzero_ps ();
+		for (k = 0; k < n_taps; ++k) {
+			a0 = _mm512_fmadd_ps (_mm512_set1_ps (h[k]), _mm512_maskz_loadu_ps (m, x + i - k), a0);
+		}
+		_mm512_mask_storeu_ps (y + i, m, _mm512_add_ps (_mm512_maskz_loadu_ps (m, y + i), a0));
+	}
+}
+
+__attribute__((target("avx512f")))
+static float peak_avx512 (const float *src, const unsigned int n_samples) {
+	const __m512i mask = _mm512_set1_epi32 (0x7fffffff);
+	__m512i pk = _mm512_setzero_si512 ();
+	unsigned int i = 0;
+	/* |x| of IEEE floats compares like integers */
+	for (; i + 16 <= n_samples; i += 16) {
+		pk = _mm512_mask_max_epi32 (pk, 0xffff, pk, _mm512_and_si512 (mask, _mm512_loadu_si512 (src + i)));
+	}
+	if (i < n_samples) {
+		const __mmask16 m = (__mmask16) ((1u << (n_samples - i)) - 1);
+		pk = _mm512_mask_max_epi32 (pk, m, pk, _mm512_and_si512 (mask, _mm512_maskz_loadu_epi32 (m, src + i)));
+	}
+	int32_t v[16];
+	int32_t rv = 0;
+	_mm512_storeu_si512 (v, pk);
+	for (i = 0; i < 16; ++i) {
+		rv = v[i] > rv ? v[i] : rv;
+	}
+	float f;
+	memcpy (&f, &rv, sizeof (f));
+	return f;
+}
+
+/* FTZ (flush to zero) and DAZ (denormals are zero) bits of the MXCSR */
+#define CLV_MXCSR_FTZ_DAZ 0x8040
+
+__attribute__((target("sse2")))
+static unsigned int mxcsr_enter (void) {
+	const unsigned int csr = _mm_getcsr ();
+	_mm_setcsr (csr | CLV_MXCSR_FTZ_DAZ);
+	return csr;
+}
+
+__attribute__((target("sse2")))
+static void mxcsr_leave (unsigned int csr) {
+	_mm_setcsr (csr);
+}
+#endif
+
+static const DSPKernels dsp_kernels[] = {
+#ifdef CLV_X86_DISPATCH
+	{ "avx512f", supported_avx512, copy_input_avx512, copy_output_avx512, mix_output_avx512, cmac_avx512, cmac_q16_avx512, fir_avx512, peak_avx512 },
+	{ "avx2",    supported_avx2,   copy_input_avx2,   copy_output_avx2,   mix_output_avx2,   cmac_avx2,   cmac_q16_avx2,   fir_avx2,   peak_avx2 },
+	{ "sse2",    supported_sse2,   copy_input_sse2,   copy_output_sse2,   mix_output_sse2,   cmac_sse2,   cmac_q16_sse2,   fir_sse2,   peak_sse2 },
+#endif
+	{ "generic", supported_c,      copy_input_c,      copy_output_c,      mix_output_c,      cmac_c,      cmac_q16_c,      fir_c,      peak_c },
+};
+
+#define N_DSP_KERNELS (sizeof (dsp_kernels) / sizeof (DSPKernels))
+
+static pthread_once_t dsp_once = PTHREAD_ONCE_INIT;
+static const DSPKernels *dsp_default = &dsp_kernels[N_DSP_KERNELS - 1];
+
+static void dsp_init (void) {
+	unsigned int i;
+	const char *env = getenv ("CONVOLV2_SIMD");
+#ifdef CLV_X86_DISPATCH
+	__builtin_cpu_init ();
+#endif
+	for (i = 0; i < N_DSP_KERNELS; ++i) {
+		if (dsp_kernels[i].supported ()) {
+			dsp_default = &dsp_kernels[i];
+			break;
+		}
+	}
+	if (env && *env) {
+		for (i = 0; i < N_DSP_KERNELS; ++i) {
+			if (!strcasecmp (env, dsp_kernels[i].name)) {
+				break;
+			}
+		}
+		if (i == N_DSP_KERNELS) {
+			fprintf (stderr, "convoLV2: unknown DSP kernel '%s' (CONVOLV2_SIMD)\n", env);
+		} else if (!dsp_kernels[i].supported ()) {
+			fprintf (stderr, "convoLV2: DSP kernel '%s' is not supported by this CPU\n", env);
+		} else {
+			dsp_default = &dsp_kernels[i];
+		}
+	}
+	VERBOSE_printf ("convoLV2: using %s DSP kernels\n", dsp_default->name);
+}
+
+/** DSP kernels for this CPU, selected once per process */
+static const DSPKernels *dsp_select (void) {
+	pthread_once (&dsp_once, dsp_init);
+	return dsp_default;
+}
+
+/* Engine memory
+ *
+ * Buffers are faulted in and optionally locked by clv_warmup() before the
+ * engine goes online, so the first periods do not page-fault on the
+ * realtime thread. Large buffers use transparent huge pages if available.
+ */
+
+#define CLV_THP_SIZE (2 << 20) ///< buffers of at least this size use huge pages
+
+/** advise transparent huge pages for a buffer, call before it is written */
+static void thp_advise (void *p, const size_t len) {
+#if !defined _WIN32 && defined MADV_HUGEPAGE
+	if (len < CLV_THP_SIZE) {
+		return;
+	}
+	const uintptr_t pg = sysconf (_SC_PAGESIZE);
+	const uintptr_t a = ((uintptr_t) p + pg - 1) & ~(pg - 1);
+	const uintptr_t e = ((uintptr_t) p + len) & ~(pg - 1);
+	if (e > a) {
+		madvise ((void*) a, e - a, MADV_HUGEPAGE);
+	}
+#endif
+}
+
+/** write every page of a buffer, keeping its content */
+static void prefault (void *p, const size_t len) {
+	volatile char *m = (volatile char*) p;
+	const size_t pg = sysconf (_SC_PAGESIZE);
+	for (size_t i = 0; i < len; i += pg) {
+		m[i] = m[i];
+	}
+	if (len > 0) {
+		m[len - 1] = m[len - 1];
+	}
+}
+
+/* Convolution engines
+ *
+ * ConvEngine abstracts the partitioned convolution backend. Engines are
+ * created and destroyed with fftw_planner_lock held.
+ *
+ * inpdata()/outdata() are one quantum long and used by buffered
+ * processing and clv_drain(). process_block() reads from and writes to
+ * the host's buffers, engines that can avoid the intermediate copy
+ * override it.
+ */
+class ConvEngine {
+public:
+	enum { FL_LATE = 1, FL_LOAD = 2 };
+
+	virtual ~ConvEngine () {}
+
+	virtual const char *name () const = 0;
+	virtual int impdata_create (unsigned int inp, unsigned int out, const float *data, int ind0, int ind1) = 0;
+	virtual int start (int priority, int policy) = 0;
+	virtual void stop () = 0;
+	/** @return true while the engine is processing */
+	virtual bool running () = 0;
+	virtual float *inpdata (unsigned int c) const = 0;
+	virtual float *outdata (unsigned int c) const = 0;
+	/** process one quantum from inpdata() to outdata(), @return FL_* flags */
+	virtual int process (bool sync) = 0;
+	virtual void print (FILE *F) = 0;
+
+	/** IR programs: impdata_create() adds data to program prog */
+	virtual int load_program (unsigned int prog) { return prog == 0 ? 0 : -1; }
+
+	/** switch programs, the output is crossfaded over fade_len samples */
+	virtual int select_program (unsigned int prog, unsigned int) { return prog == 0 ? 0 : -1; }
+
+	/** call fn for every large buffer that the engine allocated, used to lock memory.
+	 * zita-convolver's buffers are not accessible */
+	virtual void buffers (void (*fn) (void *p, size_t len, void *arg), void *arg) { }
+
+	/** process one quantum of the host buffers at offset off, output is scaled by a gain ramp */
+	virtual int process_block (const DSPKernels *dsp,
+			const float * const *inp, float * const *out, const unsigned int off,
+			const unsigned int n_inp, const unsigned int n_out, const unsigned int quantum,
+			const float offset, const float gain, const float gain_step, const bool sync)
+	{
+		unsigned int c;
+		for (c = 0; c < n_inp; ++c) {
+			dsp->copy_input (inpdata (c), inp[c] + off, quantum, offset);
+		}
+		const int f = process (sync);
+		if (running ()) {
+			for (c = 0; c < n_out; ++c) {
+				dsp->copy_output (out[c] + off, outdata (c), quantum, gain, gain_step);
+			}
+		}
+		return f;
+	}
+};
+
+/** zita-convolver: non-uniform partitions, background threads */
+class ZitaEngine : public ConvEngine {
+public:
+	ZitaEngine (unsigned int options) {
+		_cp.set_options (options);
+	}
+
+	int configure (unsigned int n_inp, unsigned int n_out, unsigned int max_size,
+			unsigned int quantum, unsigned int max_part, float density)
+	{
+#if ZITA_CONVOLVER_MAJOR_VERSION == 3
+		_cp.set_density (density);
+#endif
+		return _cp.configure (
+				/*in*/  n_inp,
+				/*out*/ n_out,
+				/*max-convolution length */ max_size,
+				/*quantum*/  quantum,
+				/*min-part*/ quantum /* must be >= fragm */,
+				/*max-part*/ max_part /* buffersize -> stich output every period */
+#if ZITA_CONVOLVER_MAJOR_VERSION == 4
+				, density
+#endif
+				);
+	}
+
+	const char *name () const { return "zita"; }
+
+	int impdata_create (unsigned int inp, unsigned int out, const float *data, int ind0, int ind1) {
+		return _cp.impdata_create (inp, out, 1, (float*) data, ind0, ind1);
+	}
+
+	int start (int priority, int policy) {
+		return _cp.start_process (priority, policy);
+	}
+
+	void stop () {
+		_cp.stop_process ();
+	}
+
+	bool running () {
+		if (_cp.state () == Convproc::ST_WAIT) {
+			_cp.check_stop ();
+		}
+		return _cp.state () == Convproc::ST_PROC;
+	}
+
+	float *inpdata (unsigned int c) const { return _cp.inpdata (c); }
+	float *outdata (unsigned int c) const { return _cp.outdata (c); }
+
+	int process (bool sync) {
+		const int f = _cp.process (sync);
+		return ((f & Convproc::FL_LATE) ? FL_LATE : 0) | ((f & Convproc::FL_LOAD) ? FL_LOAD : 0);
+	}
+
+	void print (FILE *F) {
+		_cp.print (F);
+	}
+
+private:
+	Convproc _cp;
+};
+
+/** uniformly partitioned overlap-save convolution on the calling thread.
+ *
+ * The partition size equals the quantum, the FFT size is twice that.
+ * Spectra are kept as split real/imaginary arrays (FFTW's split-array
+ * interface), the input spectra of the last n_part periods form a
+ * frequency-domain delay line per input channel.
+ *
+ * Every route can hold the spectra of several IR programs. They share
+ * the delay line, so switching programs does not lose the input history.
+ *
+ * IR partitions from index `compact' on can be stored as block-scaled
+ * int16 spectra, converted by start() once all data has been added.
+ * This halves their memory and the bandwidth to stream them each period.
+ */
+class NativeEngine : public ConvEngine {
+public:
+	NativeEngine (const DSPKernels *dsp)
+		: _dsp (dsp)
+		, _n_inp (0)
+		, _n_out (0)
+		, _quantum (0)
+		, _n_part (0)
+		, _n_full (0)
+		, _compact (0)
+		, _stride (0)
+		, _pos (0)
+		, _n_prog (1)
+		, _load (0)
+		, _prog (0)
+		, _fade_len (0)
+		, _fade_pos (0)
+		, _n_routes (0)
+		, _mem (NULL)
+		, _mem_len (0)
+		, _fwd (NULL)
+		, _inv (NULL)
+		, _running (false)
+	{
+		memset (_time, 0, sizeof (_time));
+		memset (_x_re, 0, sizeof (_x_re));
+		memset (_x_im, 0, sizeof (_x_im));
+		memset (_inp, 0, sizeof (_inp));
+		memset (_out, 0, sizeof (_out));
+		memset (_routes, 0, sizeof (_routes));
+		memset (_inp_used, 0, sizeof (_inp_used));
+		memset (_from, 0, sizeof (_from));
+		_from[0] = 1.f;
+	}
+
+	~NativeEngine () {
+		unsigned int r;
+		for (r = 0; r < _n_routes; ++r) {
+			fftwf_free (_routes[r].h_re);
+			fftwf_free (_routes[r].q_re);
+			free (_routes[r].used);
+		}
+		if (_fwd) fftwf_destroy_plan (_fwd);
+		if (_inv) fftwf_destroy_plan (_inv);
+		fftwf_free (_mem);
+	}
+
+	/** compact: first partition stored as int16, >= the number of partitions: none */
+	int configure (unsigned int n_inp, unsigned int n_out, unsigned int max_size, unsigned int quantum,
+			unsigned int n_prog, bool measure, unsigned int compact)
+	{
+		unsigned int c;
+		if (_mem || n_inp > MAX_CHANNELS || n_out > MAX_CHANNEL_MAPS || n_prog < 1
+				|| quantum < 16 || (quantum & (quantum - 1))) {
+			return -1;
+		}
+		_n_prog = n_prog;
+		_n_inp = n_inp;
+		_n_out = n_out;
+		_quantum = quantum;
+		_n_part = (max_size + quantum - 1) / quantum;
+		_n_full = _n_part;
+		_compact = compact < _n_part ? compact : _n_part;
+		_stride = (quantum + 1 + 15) & ~15; // N + 1 bins, 64 byte aligned
+
+		/* time-domain input (2N), spectra, 2 accumulators, 2 IFFT outputs (2N), inpdata, outdata */
+		const size_t n_floats = n_inp * (2 * quantum + 2 * (size_t) _n_part * _stride)
+			+ 4 * _stride + 4 * quantum + (n_inp + n_out) * quantum;
+		if (!(_mem = (float*) fftwf_malloc (n_floats * sizeof (float)))) {
+			return -1;
+		}
+		_mem_len = n_floats * sizeof (float);
+		thp_advise (_mem, _mem_len);
+		memset (_mem, 0, n_floats * sizeof (float));
+
+		float *m = _mem;
+		for (c = 0; c < n_inp; ++c) {
+			_time[c] = m; m += 2 * quantum;
+			_x_re[c] = m; m += (size_t) _n_part * _stride;
+			_x_im[c] = m; m += (size_t) _n_part * _stride;
+		}
+		_acc_re = m; m += _stride;
+		_acc_im = m; m += _stride;
+		_ifft = m; m += 2 * quantum;
+		_fade_re = m; m += _stride;
+		_fade_im = m; m += _stride;
+		_fade = m; m += 2 * quantum;
+		for (c = 0; c < n_inp; ++c) {
+			_inp[c] = m; m += quantum;
+		}
+		for (c = 0; c < n_out; ++c) {
+			_out[c] = m; m += quantum;
+		}
+
+		fftwf_iodim dim;
+		dim.n = 2 * quantum;
+		dim.is = 1;
+		dim.os = 1;
+		const unsigned flags = measure ? FFTW_MEASURE : FFTW_ESTIMATE;
+		_fwd = fftwf_plan_guru_split_dft_r2c (1, &dim, 0, NULL, _ifft, _acc_re, _acc_im, flags);
+		_inv = fftwf_plan_guru_split_dft_c2r (1, &dim, 0, NULL, _acc_re, _acc_im, _ifft, flags);
+		if (!_fwd || !_inv) {
+			return -1;
+		}
+		/* FFTW_MEASURE overwrites the arrays */
+		memset (_mem, 0, n_floats * sizeof (float));
+		return 0;
+	}
+
+	const char *name () const { return "native"; }
+
+	void buffers (void (*fn) (void *p, size_t len, void *arg), void *arg) {
+		const size_t n_h = (size_t) _n_prog * _n_full * _stride;
+		const size_t n_q = (size_t) _n_prog * (_n_part - _n_full) * _stride;
+		if (_mem) {
+			fn (_mem, _mem_len, arg);
+		}
+		for (unsigned int r = 0; r < _n_routes; ++r) {
+			if (n_h > 0) {
+				fn (_routes[r].h_re, 2 * n_h * sizeof (float), arg);
+			}
+			if (n_q > 0) {
+				fn (_routes[r].q_re, 2 * n_q * sizeof (int16_t) + n_q / CLV_Q16_BLOCK * sizeof (float), arg);
+			}
+		}
+	}
+
+	int impdata_create (unsigned int inp, unsigned int out, const float *data, int ind0, int ind1) {
+		unsigned int r, p, i;
+		if (_running || _n_full < _n_part || inp >= _n_inp || out >= _n_out || ind0 < 0 || ind1 < ind0) {
+			return -1;
+		}
+		for (r = 0; r < _n_routes; ++r) {
+			if (_routes[r].inp == inp && _routes[r].out == out) {
+				break;
+			}
+		}
+		if (r == _n_routes) {
+			if (_n_routes == MAX_CHANNEL_MAPS) {
+				return -1;
+			}
+			const size_t len = (size_t) _n_prog * _n_part * _stride;
+			float *h = (float*) fftwf_malloc (2 * len * sizeof (float));
+			unsigned char *used = (unsigned char*) calloc (_n_prog * _n_part, 1);
+			if (!h || !used) {
+				fftwf_free (h);
+				free (used);
+				return -1;
+			}
+			thp_advise (h, 2 * len * sizeof (float));
+			memset (h, 0, 2 * len * sizeof (float));
+			_routes[r].inp = inp;
+			_routes[r].out = out;
+			_routes[r].h_re = h;
+			_routes[r].h_im = h + len;
+			_routes[r].used = used;
+			_inp_used[inp] = true;
+			++_n_routes;
+		}
+
+		/* IR partitions are zero-padded to the FFT size and normalized,
+		 * data is added to existing partitions (same as zita-convolver).
+		 * All-zero partitions are skipped when processing. */
+		const unsigned int N = _quantum;
+		const float norm = .5f / N;
+		for (p = 0; p < _n_part; ++p) {
+			const int p0 = p * N;
+			const int p1 = p0 + N;
+			if (p1 <= ind0 || p0 >= ind1) {
+				continue;
+			}
+			bool nonzero = false;
+			memset (_ifft, 0, 2 * N * sizeof (float));
+			for (i = 0; i < N; ++i) {
+				if (p0 + (int) i >= ind0 && p0 + (int) i < ind1) {
+					_ifft[i] = data[p0 + i - ind0] * norm;
+					nonzero |= _ifft[i] != 0.f;
+				}
+			}
+			if (!nonzero) {
+				continue;
+			}
+			const size_t k = (size_t) _load * _n_part + p;
+			_routes[r].used[k] = 1;
+			fftwf_execute_split_dft_r2c (_fwd, _ifft, _acc_re, _acc_im);
+			float *h_re = _routes[r].h_re + k * _stride;
+			float *h_im = _routes[r].h_im + k * _stride;
+			for (i = 0; i <= N; ++i) {
+				h_re[i] += _acc_re[i];
+				h_im[i] += _acc_im[i];
+			}
+		}
+		memset (_acc_re, 0, 2 * _stride * sizeof (float));
+		memset (_ifft, 0, 2 * N * sizeof (float));
+		return 0;
+	}
+
+	int start (int, int) {
+		if (_n_full > _compact && compact ()) {
+			return -1;
+		}
+		_running = true;
+		return 0;
+	}
+
+	void stop () {
+		_running = false;
+	}
+
+	bool running () {
+		return _running;
+	}
+
+	float *inpdata (unsigned int c) const { return _inp[c]; }
+	float *outdata (unsigned int c) const { return _out[c]; }
+
+	int process (bool) {
+		run (_inp, 0, _n_inp, _out, 0, _n_out, 0.f, 1.f, 0.f);
+		return 0;
+	}
+
+	int process_block (const DSPKernels *,
+			const float * const *inp, float * const *out, const unsigned int off,
+			const unsigned int n_inp, const unsigned int n_out, const unsigned int,
+			const float offset, const float gain, const float gain_step, const bool)
+	{
+		run (inp, off, n_inp, out, off, n_out, offset, gain, gain_step);
+		return 0;
+	}
+
+	int load_program (unsigned int prog) {
+		if (_running || prog >= _n_prog) {
+			return -1;
+		}
+		_load = prog;
+		return 0;
+	}
+
+	/* realtime safe, called from the process thread */
+	int select_program (unsigned int prog, unsigned int fade_len) {
+		if (prog >= _n_prog) {
+			return -1;
+		}
+		if (prog == _prog) {
+			return 0;
+		}
+		if (_fade_pos < _fade_len) {
+			/* a fade in progress is restarted from the current mix of programs */
+			const float g = _fade_pos / (float) _fade_len;
+			unsigned int k;
+			for (k = 0; k < _n_prog; ++k) {
+				_from[k] *= 1.f - g;
+			}
+			_from[_prog] += g;
+		} else {
+			memset (_from, 0, sizeof (_from));
+			_from[_prog] = 1.f;
+		}
+		_prog = prog;
+		_fade_len = fade_len;
+		_fade_pos = 0;
+		return 0;
+	}
+
+	void print (FILE *F) {
+		unsigned int r, p, n_used = 0;
+		for (r = 0; r < _n_routes; ++r) {
+			for (p = 0; p < _n_prog * _n_part; ++p) {
+				n_used += _routes[r].used[p];
+			}
+		}
+		fprintf (F, "native engine: in: %u, out: %u, routes: %u, programs: %u, partition size: %u, partitions: %u (%u of %u non-zero), kernels: %s\n",
+				_n_inp, _n_out, _n_routes, _n_prog, _quantum, _n_part, n_used, _n_prog * _n_part * _n_routes, _dsp->name);
+
+		/* IR spectra in memory, and the spectra read per period by the active program (IR and input) */
+		const size_t bins = _stride;
+		const size_t full_part = 2 * bins * sizeof (float);
+		const size_t q16_part = 2 * bins * sizeof (int16_t) + bins / CLV_Q16_BLOCK * sizeof (float);
+		size_t n_read_full = 0, n_read_q16 = 0;
+		for (r = 0; r < _n_routes; ++r) {
+			for (p = 0; p < _n_part; ++p) {
+				if (_routes[r].used[(size_t) _prog * _n_part + p]) {
+					++(p < _n_full ? n_read_full : n_read_q16);
+				}
+			}
+		}
+		const size_t n_stored = (size_t) _n_routes * _n_prog;
+		const double mem_float = n_stored * _n_part * full_part / 1048576.;
+		const double mem = n_stored * (_n_full * full_part + (_n_part - _n_full) * q16_part) / 1048576.;
+		const double bw_float = (n_read_full + n_read_q16) * 2 * full_part / 1024.;
+		const double bw = (n_read_full * 2 * full_part + n_read_q16 * (full_part + q16_part)) / 1024.;
+		if (_n_full < _n_part) {
+			fprintf (F, "native engine: int16 partitions from %u, IR spectra: %.2f MiB (float: %.2f MiB), read per period: %.1f KiB (float: %.1f KiB)\n",
+					_n_full, mem, mem_float, bw, bw_float);
+		} else {
+			fprintf (F, "native engine: IR spectra: %.2f MiB, read per period: %.1f KiB\n", mem, bw);
+		}
+	}
+
+private:
+	/** convert partitions from _compact on to block-scaled int16, all programs */
+	int compact () {
+		unsigned int r, p, k, b, i;
+		const size_t n_q = (size_t) _n_prog * (_n_part - _compact) * _stride;
+		const size_t n_h = (size_t) _n_prog * _compact * _stride;
+		for (r = 0; r < _n_routes; ++r) {
+			Route& rt = _routes[r];
+			/* int16 re, im, followed by the scale factors. 64 byte aligned: stride is a multiple of 16 */
+			int16_t *q = (int16_t*) fftwf_malloc (2 * n_q * sizeof (int16_t) + n_q / CLV_Q16_BLOCK * sizeof (float));
+			float *h = n_h > 0 ? (float*) fftwf_malloc (2 * n_h * sizeof (float)) : NULL;
+			if (!q || (n_h > 0 && !h)) {
+				fftwf_free (q);
+				fftwf_free (h);
+				return -1;
+			}
+			thp_advise (q, 2 * n_q * sizeof (int16_t));
+			if (h) {
+				thp_advise (h, 2 * n_h * sizeof (float));
+			}
+			float *scale = (float*) (q + 2 * n_q);
+			for (k = 0; k < _n_prog; ++k) {
+				for (p = 0; p < _n_part; ++p) {
+					const float *src_re = rt.h_re + ((size_t) k * _n_part + p) * _stride;
+					const float *src_im = rt.h_im + ((size_t) k * _n_part + p) * _stride;
+					if (p < _compact) {
+						const size_t o = ((size_t) k * _compact + p) * _stride;
+						memcpy (h + o, src_re, _stride * sizeof (float));
+						memcpy (h + n_h + o, src_im, _stride * sizeof (float));
+						continue;
+					}
+					const size_t o = ((size_t) k * (_n_part - _compact) + p - _compact) * _stride;
+					for (b = 0; b < _stride; b += CLV_Q16_BLOCK) {
+						float pk = 0.f;
+						for (i = b; i < b + CLV_Q16_BLOCK; ++i) {
+							pk = fmaxf (pk, fmaxf (fabsf (src_re[i]), fabsf (src_im[i])));
+						}
+						const float s = pk / 32767.f;
+						const float g = pk > 0.f ? 32767.f / pk : 0.f;
+						scale[(o + b) / CLV_Q16_BLOCK] = s;
+						for (i = b; i < b + CLV_Q16_BLOCK; ++i) {
+							q[o + i] = (int16_t) lrintf (src_re[i] * g);
+							q[n_q + o + i] = (int16_t) lrintf (src_im[i] * g);
+						}
+					}
+				}
+			}
+			fftwf_free (rt.h_re);
+			rt.h_re = h;
+			rt.h_im = h ? h + n_h : NULL;
+			rt.q_re = q;
+			rt.q_im = q + n_q;
+			rt.q_scale = scale;
+		}
+		_n_full = _compact;
+		return 0;
+	}
+
+	/** one quantum: input is read from and output written to the given buffers directly */
+	void run (const float * const *inp, const unsigned int in_off, const unsigned int n_inp,
+			float * const *out, const unsigned int out_off, const unsigned int n_out,
+			const float offset, const float gain, const float gain_step)
+	{
+		unsigned int c;
+		const unsigned int N = _quantum;
+
+		_pos = _pos + 1 < _n_part ? _pos + 1 : 0;
+
+		/* every input is transformed once, regardless of the number of outputs it feeds */
+		for (c = 0; c < _n_inp; ++c) {
+			if (!_inp_used[c]) {
+				continue;
+			}
+			float *t = _time[c];
+			memcpy (t, t + N, N * sizeof (float));
+			if (c < n_inp) {
+				_dsp->copy_input (t + N, inp[c] + in_off, N, offset);
+			} else {
+				memset (t + N, 0, N * sizeof (float));
+			}
+			fftwf_execute_split_dft_r2c (_fwd, t,
+					_x_re[c] + (size_t) _pos * _stride,
+					_x_im[c] + (size_t) _pos * _stride);
+		}
+
+		const bool fade = _fade_pos < _fade_len;
+
+		for (c = 0; c < _n_out && c < n_out; ++c) {
+			if (fade) {
+				accumulate_from (c);
+			}
+			if (!accumulate (c, _prog, _acc_re, _acc_im)) {
+				memset (out[c] + out_off, 0, N * sizeof (float));
+				continue;
+			}
+			fftwf_execute_split_dft_c2r (_inv, _acc_re, _acc_im, _ifft);
+			if (fade) {
+				/* all programs convolve the same input: linear crossfade */
+				unsigned int i;
+				fftwf_execute_split_dft_c2r (_inv, _fade_re, _fade_im, _fade);
+				for (i = 0; i < N; ++i) {
+					const float g = _fade_pos + i < _fade_len ? (_fade_pos + i) / (float) _fade_len : 1.f;
+					_ifft[N + i] = _fade[N + i] + g * (_ifft[N + i] - _fade[N + i]);
+				}
+			}
+			/* overlap-save: the 2nd half is the linear convolution */
+			_dsp->copy_output (out[c] + out_off, _ifft + N, N, gain, gain_step);
+		}
+
+		if (fade) {
+			_fade_pos += N;
+		}
+	}
+
+	/** output spectrum c at the start of the crossfade in _fade_re/_fade_im,
+	 * the programs weighted by _from. Uses _acc_re/_acc_im as scratch */
+	void accumulate_from (const unsigned int c) {
+		unsigned int k, i;
+		bool first = true;
+		for (k = 0; k < _n_prog; ++k) {
+			const float w = _from[k];
+			if (w == 0.f) {
+				continue;
+			}
+			if (first) {
+				accumulate (c, k, _fade_re, _fade_im);
+				for (i = 0; i < _stride && w != 1.f; ++i) {
+					_fade_re[i] *= w;
+					_fade_im[i] *= w;
+				}
+				first = false;
+				continue;
+			}
+			accumulate (c, k, _acc_re, _acc_im);
+			for (i = 0; i < _stride; ++i) {
+				_fade_re[i] += w * _acc_re[i];
+				_fade_im[i] += w * _acc_im[i];
+			}
+		}
+	}
+
+	/** sum of all routes to output c in the frequency domain, @return false if there are none */
+	bool accumulate (const unsigned int c, const unsigned int prog, float *acc_re, float *acc_im) {
+		unsigned int r, p;
+		bool active = false;
+		memset (acc_re, 0, _stride * sizeof (float));
+		memset (acc_im, 0, _stride * sizeof (float));
+		for (r = 0; r < _n_routes; ++r) {
+			const Route& rt = _routes[r];
+			if (rt.out != c) {
+				continue;
+			}
+			active = true;
+			const unsigned char *used = rt.used + (size_t) prog * _n_part;
+			const float *h_re = rt.h_re + (size_t) prog * _n_full * _stride;
+			const float *h_im = rt.h_im + (size_t) prog * _n_full * _stride;
+			/* partition p is applied to the input spectrum of p periods ago */
+			for (p = 0; p < _n_part; ++p) {
+				if (!used[p]) {
+					continue;
+				}
+				const size_t x = (size_t) (_pos >= p ? _pos - p : _pos + _n_part - p) * _stride;
+				if (p < _n_full) {
+					const size_t h = (size_t) p * _stride;
+					_dsp->cmac (acc_re, acc_im,
+							_x_re[rt.inp] + x, _x_im[rt.inp] + x,
+							h_re + h, h_im + h, _stride);
+				} else {
+					const size_t q = ((size_t) prog * (_n_part - _n_full) + p - _n_full) * _stride;
+					_dsp->cmac_q16 (acc_re, acc_im,
+							_x_re[rt.inp] + x, _x_im[rt.inp] + x,
+							rt.q_re + q, rt.q_im + q, rt.q_scale + q / CLV_Q16_BLOCK, _stride);
+				}
+			}
+		}
+		return active;
+	}
+
+	typedef struct {
+		unsigned int inp;
+		unsigned int out;
+		float *h_re; ///< IR spectra, n_prog * n_full * stride bins
+		float *h_im;
+		int16_t *q_re; ///< compact IR spectra, n_prog * (n_part - n_full) * stride bins
+		int16_t *q_im;
+		float *q_scale; ///< per CLV_Q16_BLOCK bins of q_re and q_im
+		unsigned char *used; ///< per program and partition, 0: all-zero
+	} Route;
+
+	const DSPKernels *_dsp;
+	unsigned int _n_inp;
+	unsigned int _n_out;
+	unsigned int _quantum; ///< partition size
+	unsigned int _n_part; ///< partitions per route
+	unsigned int _n_full; ///< partitions per route and program stored as float
+	unsigned int _compact; ///< first partition to store as int16
+	unsigned int _stride; ///< spectrum length, N + 1 bins rounded up to 16
+	unsigned int _pos; ///< current slot in the frequency-domain delay line
+	unsigned int _n_prog; ///< IR programs per route
+	unsigned int _load; ///< program that impdata_create() adds to
+	unsigned int _prog; ///< active program
+	float _from[MAX_PROGRAMS]; ///< weight of each program at the start of the crossfade
+	unsigned int _fade_len; ///< crossfade length, samples
+	unsigned int _fade_pos; ///< samples since the program was selected
+	unsigned int _n_routes;
+	Route _routes[MAX_CHANNEL_MAPS];
+
+	float *_mem; ///< all buffers except IR spectra
+	size_t _mem_len; ///< size of _mem, bytes
+	float *_time[MAX_CHANNELS]; ///< last two periods of input, per input
+	float *_x_re[MAX_CHANNELS]; ///< input spectra, n_part * stride per input
+	float *_x_im[MAX_CHANNELS];
+	float *_acc_re; ///< output spectrum accumulator
+	float *_acc_im;
+	float *_ifft; ///< IFFT output, also FFT scratch during impdata_create()
+	float *_fade_re; ///< output spectrum at the start of the crossfade, see accumulate_from()
+	float *_fade_im;
+	float *_fade; ///< IFFT output of _fade_re/_fade_im
+	float *_inp[MAX_CHANNELS]; ///< inpdata()
+	float *_out[MAX_CHANNEL_MAPS]; ///< outdata(), one per route with the route mixer
+	bool _inp_used[MAX_CHANNELS]; ///< input is routed to an output
+
+	fftwf_plan _fwd;
+	fftwf_plan _inv;
+	bool _running;
+};
+
+enum {
+	CLV_ENGINE_ZITA = 0,
+	CLV_ENGINE_NATIVE,
+};
+
+struct LV2convolv {
+	ConvEngine *engine;
+
+	/* IR file */
+	char *ir_fn; ///< path to IR file
+	int custom_map; ///< use the configured routes instead of the channel-map conventions
+	unsigned int chn_inp[MAX_CHANNEL_MAPS]; ///< I/O channel map: ir_map[id] = in-channel, 1-based; 0: unused route
+	unsigned int chn_out[MAX_CHANNEL_MAPS]; ///< I/O channel map: ir_map[id] = out-channel, 1-based; 0: unused route
+	unsigned int ir_chan[MAX_CHANNEL_MAPS]; ///< IR channel map: ir_chan[id] = file-channel;
+	unsigned int ir_delay[MAX_CHANNEL_MAPS]; ///< pre-delay ; value >=0
+	float ir_gain[MAX_CHANNEL_MAPS]; ///< IR-gain value: float -inf..+inf
+	int ir_disk_cache; ///< keep resampled IRs in the per-user cache directory
+	float ir_trim; ///< tail trim threshold of the energy decay curve [dB], 0: off
+	IRProgram prog[MAX_PROGRAMS]; ///< IR data, 0: ir_fn, 1..: bank
+	unsigned int n_programs; ///< programs loaded by clv_initialize()
+	unsigned int program; ///< selected program
+	char *bank_fn[MAX_PROGRAMS]; ///< bank entries 1..MAX_PROGRAMS-1 (convolution.bank.N)
+	char *bank_dir; ///< directory with IR files, used if there are no bank entries
+	unsigned int bank_fade; ///< program crossfade, ms
+	unsigned int bank_fade_len; ///< program crossfade, samples
+
+	/* convolution settings*/
+	int engine_type; ///< CLV_ENGINE_ZITA or CLV_ENGINE_NATIVE
+	unsigned int size; ///< max length of convolution computation
+	float density; ///< density; 0<= dens <= 1.0 ; '0' = auto (1.0 / min(inchn,outchn)
+	int nonuniform; ///< partitioning: 0: uniform period-sized partitions, 1: non-uniform
+	unsigned int max_part; ///< largest partition size for non-uniform partitioning
+	int fftw_wisdom; ///< measure FFTW plans, persist wisdom in the per-user cache directory
+
+	/* background processing */
+	int threaded; ///< 0: process() waits for background partitions (sync), 1: async
+	int thread_policy; ///< scheduling policy of level threads, -1: same as audio thread
+	int thread_prio; ///< priority offset of level threads relative to the audio thread
+	int rt_policy; ///< scheduling policy of the audio thread (reference)
+	int rt_prio; ///< priority of the audio thread (reference)
+
+	/* process settings */
+	const DSPKernels *dsp; ///< SIMD kernels for this CPU
+	int ftz; ///< flush denormals using FTZ/DAZ instead of adding an offset
+	unsigned int fragment_size; ///< process period-size
+	int buffered; ///< process arbitrary block-lengths, adds one fragment of latency
+	int host_buffered; ///< buffered processing is required by the host
+	unsigned int fifo_pos; ///< buffered processing: offset in current fragment
+	int rebuffered; ///< zero-latency engine switched to buffered processing by clv_rebuffer()
+	float *rb_inp[MAX_CHANNELS]; ///< rebuffered: per input, one fragment
+	float *rb_out[MAX_CHANNELS]; ///< rebuffered: per output, one fragment
+	unsigned int rb_pos; ///< rebuffered: offset in the current fragment
+	int standby; ///< standby engine, minimal period to cover block-size changes
+	int standby_enable; ///< build a standby engine (used by the plugin, opt-in)
+	unsigned int crossfade; ///< IR change crossfade length in ms (used by the plugin)
+	unsigned int n_inp; ///< input channel count
+	unsigned int n_out; ///< output channel count
+	unsigned int tail_len; ///< convolution length, samples
+
+	/* hybrid: FIR head on the audio thread, the FFT engine runs one partition late */
+	int hybrid; ///< enable hybrid processing
+	unsigned int hybrid_head; ///< FIR head length, 0: calibrate
+	unsigned int fir_len; ///< FIR head length and FFT partition size in use, 0: FFT only
+	unsigned int fir_k0[MAX_CHANNEL_MAPS]; ///< per route: first tap of the FIR head
+	unsigned int fir_k1[MAX_CHANNEL_MAPS]; ///< per route: end of the FIR head
+	float *fir_coef[MAX_CHANNEL_MAPS]; ///< per route: fir_len taps
+	float *fir_hist[MAX_CHANNELS]; ///< per input: fir_len - 1 past samples and one fragment
+	float *fir_out[MAX_CHANNELS]; ///< per output: one fragment
+
+	/* reduced-rate tail: the IR beyond rr_split is convolved at rate / rr_factor */
+	unsigned int rr_factor; ///< decimation factor 1 (off), 2 or 4
+	unsigned int rr_split; ///< crossover position in the IR, samples
+	ConvEngine *rr_engine; ///< engine for the decimated tail, NULL: off
+	unsigned int rr_part; ///< period of rr_engine, decimated samples
+	unsigned int rr_pos; ///< offset in the current period of rr_engine
+	float *rr_coef; ///< polyphase low-pass, rr_factor branches of RR_TAPS
+	float *rr_dec[MAX_CHANNELS]; ///< per input: polyphase history of the decimation filter
+	float *rr_int[MAX_CHANNELS]; ///< per output: history of the interpolation filter
+	float *rr_out[MAX_CHANNELS]; ///< per output: one fragment
+	float *rr_tmp; ///< one interpolation branch
+
+	/* compact IR spectra (native engine) */
+	int compact; ///< store partitions beyond compact_split as block-scaled int16
+	unsigned int compact_split; ///< IR offset of the first compact partition, samples
+
+	/* route mixer: every route is a separate engine output, its gain and
+	 * delay are applied after the convolution and can change while processing */
+	int mix; ///< enable the route mixer
+	float mix_gain_set[MAX_CHANNEL_MAPS]; ///< per route: gain, last value set (state), atomic
+	unsigned int mix_delay_set[MAX_CHANNEL_MAPS]; ///< per route: delay in samples, last value set (state), atomic
+	uint64_t mix_dirty; ///< bitmask: routes set since the last fragment, atomic
+	unsigned int mix_delay_max; ///< longest delay, samples
+	unsigned int mix_n_routes; ///< engine outputs
+	unsigned int mix_route[MAX_CHANNEL_MAPS]; ///< engine output -> route
+	float mix_gain[MAX_CHANNEL_MAPS]; ///< per route: gain in use
+	float mix_target[MAX_CHANNEL_MAPS]; ///< per route: gain to approach
+	unsigned int mix_delay[MAX_CHANNEL_MAPS]; ///< per route: delay to use
+	unsigned int mix_delay_prev[MAX_CHANNEL_MAPS]; ///< per route: delay used in the previous fragment
+	unsigned int mix_ramp[MAX_CHANNEL_MAPS]; ///< per route: remaining samples of the gain ramp
+	unsigned int mix_ramp_len; ///< gain ramp, samples
+	float *mix_line[MAX_CHANNEL_MAPS]; ///< per engine output: delay line
+	unsigned int mix_mask; ///< delay line length - 1
+	unsigned int mix_wpos; ///< delay line write position, a multiple of the fragment size
+	float *mix_out[MAX_CHANNELS]; ///< per output: mixed fragment
+
+	/* input silence bypass */
+	int bypass; ///< skip the engine once its response to silent input has decayed
+	unsigned int settle_len; ///< silent input that needs to be processed before bypassing
+	unsigned int silent_len; ///< consecutive silent input processed, saturates at settle_len
+
+	/* tail handover: engine is fed silence after it went offline */
+	int draining; ///< clv_drain() has been called
+	unsigned int drain_pos; ///< read position in current output fragment
+	unsigned int drain_left; ///< remaining tail samples
+
+	/* engine memory, see clv_warmup() */
+	int mlock; ///< lock engine buffers in memory
+	size_t locked; ///< bytes locked
+	unsigned int warmup_len; ///< silent input that runs every partition at least once, samples
+
+	/* cancellation of clv_initialize() */
+	int (*abort_cb) (void *arg); ///< polled between initialization steps, non-zero aborts
+	void *abort_arg;
+
+	/* statistics, written by the realtime thread only */
+	double proc_time; ///< time spent in the engine during the last clv_convolve() or clv_drain() call [ms]
+	unsigned long n_late; ///< periods in which background partitions were not ready
+	unsigned long n_load; ///< overload events (repeatedly late)
+	unsigned long n_bypass; ///< fragments that were not processed (silent input)
+	unsigned long n_periods; ///< clv_convolve() calls that processed the engine
+	double first_time; ///< proc_time of the first of those calls [ms]
+	double sum_time; ///< proc_time of all of those calls [ms]
+};
+
+
+/** monotonic time in milliseconds, used for profiling */
+static double clv_time_ms () {
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/* Hybrid split calibration.
+ *
+ * The cost of the FIR kernel and of FFT partitions is measured once per
+ * process and partition size, and used to estimate the cost of a
+ * configuration without building it.
+ */
+#define CALIB_MIN_PART 64u
+#define CALIB_MAX_PART 8192u
+#define CALIB_N_PART   8 // 64 .. 8192
+
+typedef struct {
+	double fft; ///< forward and inverse FFT of twice the partition size [ns]
+	double cmac; ///< complex MAC of one partition [ns]
+} FFTCost;
+
+static pthread_mutex_t calib_lock = PTHREAD_MUTEX_INITIALIZER;
+static double calib_fir = 0; ///< FIR cost per tap and sample [ns]
+static FFTCost calib_fft[CALIB_N_PART];
+
+static unsigned int calib_index (unsigned int part) {
+	unsigned int i = 0;
+	while ((CALIB_MIN_PART << i) < part && i + 1 < CALIB_N_PART) {
+		++i;
+	}
+	return i;
+}
+
+/** fastest of 5 runs of n_iter calls of the FIR kernel, ns per tap and sample */
+static double calib_measure_fir (const DSPKernels *dsp) {
+	const unsigned int n_taps = 256;
+	const unsigned int n_samples = 256;
+	const unsigned int n_iter = 16;
+	double best = 0;
+	unsigned int i, r;
+	float *x = (float*) calloc (n_taps + n_samples, sizeof (float));
+	float *h = (float*) calloc (n_taps, sizeof (float));
+	float *y = (float*) calloc (n_samples, sizeof (float));
+	if (!x || !h || !y) {
+		free (x); free (h); free (y);
+		return 0;
+	}
+	for (i = 0; i < n_taps; ++i) {
+		h[i] = 1e-3f * (i & 7);
+	}
+	for (r = 0; r < 5; ++r) {
+		const double t0 = clv_time_ms ();
+		for (i = 0; i < n_iter; ++i) {
+			dsp->fir (y, x + n_taps - 1, h, n_taps, n_samples);
+		}
+		const double dt = 1e6 * (clv_time_ms () - t0) / (n_iter * n_taps * n_samples);
+		if (r == 0 || dt < best) {
+			best = dt;
+		}
+	}
+	free (x); free (h); free (y);
+	return best;
+}
+
+/** fastest of 5 runs, cost of one partition of the given size */
+static int calib_measure_fft (const DSPKernels *dsp, const unsigned int part, FFTCost *cost) {
+	const unsigned int stride = (part + 1 + 15) & ~15;
+	const unsigned int n_iter = 1 + 32768 / part;
+	unsigned int i, r;
+	float *m = (float*) fftwf_malloc ((2 * part + 4 * stride) * sizeof (float));
+	if (!m) {
+		return -1;
+	}
+	memset (m, 0, (2 * part + 4 * stride) * sizeof (float));
+	float *t = m;
+	float *re = m + 2 * part;
+	float *im = re + stride;
+	float *h_re = im + stride;
+	float *h_im = h_re + stride;
+
+	fftwf_iodim dim;
+	dim.n = 2 * part;
+	dim.is = 1;
+	dim.os = 1;
+	pthread_mutex_lock (&fftw_planner_lock);
+	fftwf_plan fwd = fftwf_plan_guru_split_dft_r2c (1, &dim, 0, NULL, t, re, im, FFTW_ESTIMATE);
+	fftwf_plan inv = fftwf_plan_guru_split_dft_c2r (1, &dim, 0, NULL, re, im, t, FFTW_ESTIMATE);
+	pthread_mutex_unlock (&fftw_planner_lock);
+
+	int rv = -1;
+	if (fwd && inv) {
+		for (r = 0; r < 5; ++r) {
+			double t0 = clv_time_ms ();
+			for (i = 0; i < n_iter; ++i) {
+				fftwf_execute_split_dft_r2c (fwd, t, re, im);
+				fftwf_execute_split_dft_c2r (inv, re, im, t);
+			}
+			const double t_fft = 1e6 * (clv_time_ms () - t0) / n_iter;
+			t0 = clv_time_ms ();
+			for (i = 0; i < n_iter; ++i) {
+				dsp->cmac (re, im, h_re, h_im, h_re, h_im, stride);
+			}
+			const double t_cmac = 1e6 * (clv_time_ms () - t0) / n_iter;
+			if (r == 0 || t_fft < cost->fft) cost->fft = t_fft;
+			if (r == 0 || t_cmac < cost->cmac) cost->cmac = t_cmac;
+		}
+		rv = 0;
+	}
+
+	pthread_mutex_lock (&fftw_planner_lock);
+	if (fwd) fftwf_destroy_plan (fwd);
+	if (inv) fftwf_destroy_plan (inv);
+	pthread_mutex_unlock (&fftw_planner_lock);
+	fftwf_free (m);
+	return rv;
+}
+
+/** measured FFT cost of a partition size, measure on first use */
+static int calib_fft_cost (const DSPKernels *dsp, const unsigned int part, FFTCost *cost) {
+	int rv = 0;
+	const unsigned int i = calib_index (part);
+	pthread_mutex_lock (&calib_lock);
+	if (calib_fft[i].fft <= 0) {
+		rv = calib_measure_fft (dsp, CALIB_MIN_PART << i, &calib_fft[i]);
+	}
+	*cost = calib_fft[i];
+	pthread_mutex_unlock (&calib_lock);
+	return rv;
+}
+
+/** estimated cost of uniformly partitioned convolution per sample [ns] */
+static double calib_engine_cost (const FFTCost *fc, const unsigned int part, const unsigned int len,
+		const unsigned int n_inp, const unsigned int n_out, const unsigned int n_routes)
+{
+	const unsigned int n_part = (len + part - 1) / part;
+	return (.5 * fc->fft * (n_inp + n_out) + fc->cmac * n_part * n_routes) / part;
+}
+
+/** find the cheapest FIR head length for the given period.
+ * The FFT partition size equals the head length, 0: FFT only.
+ */
+static unsigned int calib_hybrid_split (const DSPKernels *dsp, const unsigned int period, const unsigned int len,
+		const unsigned int n_inp, const unsigned int n_out, const unsigned int n_routes)
+{
+	FFTCost fc;
+	unsigned int part, best_part = 0;
+	double best;
+
+	pthread_mutex_lock (&calib_lock);
+	if (calib_fir <= 0) {
+		calib_fir = calib_measure_fir (dsp);
+	}
+	const double t_fir = calib_fir;
+	pthread_mutex_unlock (&calib_lock);
+
+	if (t_fir <= 0 || calib_fft_cost (dsp, period, &fc)) {
+		return 0;
+	}
+	best = calib_engine_cost (&fc, period, len, n_inp, n_out, n_routes);
+	VERBOSE_printf("convoLV2: hybrid calibration: FFT only, partition %u: %.1f ns/sample\n", period, best);
+
+	for (part = 2 * period; part <= CALIB_MAX_PART && part < len; part *= 2) {
+		if (calib_fft_cost (dsp, part, &fc)) {
+			break;
+		}
+		const double cost = t_fir * part * n_routes
+			+ calib_engine_cost (&fc, part, len - part, n_inp, n_out, n_routes);
+		VERBOSE_printf("convoLV2: hybrid calibration: FIR head %u, partition %u: %.1f ns/sample\n", part, part, cost);
+		if (cost < best) {
+			best = cost;
+			best_part = part;
+		}
+	}
+	return best_part;
+}
+
+#ifndef _WIN32
+/** get path of a file in the per-user cache directory,
+ * $XDG_CACHE_HOME/convoLV2/ or $HOME/.cache/convoLV2/
+ * The directory is created if it does not exist.
+ */
+static int cache_path (char *path, size_t len, const char *name) {
+	const char *xdg = getenv ("XDG_CACHE_HOME");
+	const char *home = getenv ("HOME");
+	char dir[1024];
+
+	if (xdg && *xdg) {
+		snprintf (dir, sizeof (dir), "%s", xdg);
+	} else if (home && *home) {
+		snprintf (dir, sizeof (dir), "%s/.cache", home);
+	} else {
+		return -1;
+	}
+	if (mkdir (dir, 0755) && errno != EEXIST) {
+		return -1;
+	}
+	strncat (dir, "/convoLV2", sizeof (dir) - strlen (dir) - 1);
+	if (mkdir (dir, 0755) && errno != EEXIST) {
+		return -1;
+	}
+	if (snprintf (path, len, "%s/%s", dir, name) >= (int) len) {
+		return -1;
+	}
+	return 0;
+}
+
+/* resampled IR cache file: header followed by interleaved float32 samples */
+typedef struct {
+	char magic[8];
+	uint64_t hash; ///< hash of the IR file content
+	uint32_t rate; ///< target sample-rate
+	uint32_t quality; ///< SRC converter
+	uint32_t n_chan;
+	uint32_t n_frames;
+} SRCCacheHeader;
+
+#define SRC_CACHE_MAGIC "clv2f32"
+
+/** FNV-1a hash of the file's content */
+static int file_hash (const char *fn, uint64_t *hash) {
+	struct stat st;
+	int fd = open (fn, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat (fd, &st) || st.st_size == 0) {
+		close (fd);
+		return -1;
+	}
+	const uint8_t *d = (const uint8_t*) mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (d == MAP_FAILED) {
+		return -1;
+	}
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (off_t i = 0; i < st.st_size; ++i) {
+		h ^= d[i];
+		h *= 0x100000001b3ULL;
+	}
+	munmap ((void*) d, st.st_size);
+	*hash = h;
+	return 0;
+}
+
+static void src_cache_name (char *name, size_t len, const uint64_t hash, const int sample_rate) {
+	snprintf (name, len, "ir-%016llx-%d-q%d.f32", (unsigned long long) hash, sample_rate, (int) SRC_QUALITY);
+}
+
+/** map a cached resampled IR, *buf points into the mapping */
+static int src_cache_load (const uint64_t hash, const int sample_rate, const unsigned int n_chan,
+		float **buf, size_t *map_len, unsigned int *n_sp) {
+	char name[64], path[1024];
+	struct stat st;
+	src_cache_name (name, sizeof (name), hash, sample_rate);
+	if (cache_path (path, sizeof (path), name)) {
+		return -1;
+	}
+	int fd = open (path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat (fd, &st) || st.st_size < (off_t) sizeof (SRCCacheHeader)) {
+		close (fd);
+		return -1;
+	}
+	void *m = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (m == MAP_FAILED) {
+		return -1;
+	}
+	const SRCCacheHeader *h = (const SRCCacheHeader*) m;
+	if (memcmp (h->magic, SRC_CACHE_MAGIC, sizeof (h->magic))
+			|| h->hash != hash || h->rate != (uint32_t) sample_rate
+			|| h->quality != (uint32_t) SRC_QUALITY || h->n_chan != n_chan
+			|| (off_t) (sizeof (SRCCacheHeader) + (size_t) h->n_chan * h->n_frames * sizeof (float)) != st.st_size) {
+		munmap (m, st.st_size);
+		return -1;
+	}
+	*buf = (float*) ((char*) m + sizeof (SRCCacheHeader));
+	*map_len = st.st_size;
+	*n_sp = h->n_frames;
+	return 0;
+}
+
+static void src_cache_store (const uint64_t hash, const int sample_rate, const unsigned int n_chan,
+		const float *buf, const unsigned int n_sp) {
+	char name[64], path[1024], tmp[1100];
+	SRCCacheHeader h;
+	src_cache_name (name, sizeof (name), hash, sample_rate);
+	if (cache_path (path, sizeof (path), name)) {
+		return;
+	}
+	memset (&h, 0, sizeof (h));
+	memcpy (h.magic, SRC_CACHE_MAGIC, sizeof (h.magic));
+	h.hash = hash;
+	h.rate = sample_rate;
+	h.quality = SRC_QUALITY;
+	h.n_chan = n_chan;
+	h.n_frames = n_sp;
+
+	/* write to a temporary file first, other instances may read concurrently */
+	snprintf (tmp, sizeof (tmp), "%s.%d", path, (int) getpid ());
+	FILE *f = fopen (tmp, "wb");
+	if (!f) {
+		return;
+	}
+	if (fwrite (&h, sizeof (h), 1, f) != 1 || fwrite (buf, sizeof (float) * n_chan, n_sp, f) != n_sp) {
+		fclose (f);
+		unlink (tmp);
+		return;
+	}
+	if (fclose (f) || rename (tmp, path)) {
+		unlink (tmp);
+		return;
+	}
+	VERBOSE_printf("convoLV2: cached resampled IR: %s\n", path);
+}
+
+/** FFTW wisdom file for the given partition sizes */
+static int wisdom_path (char *path, size_t len, const unsigned int min_part, const unsigned int max_part) {
+	char name[64];
+	snprintf (name, sizeof (name), "fftw-wisdom-%u-%u", min_part, max_part);
+	return cache_path (path, len, name);
+}
+
+/** merge wisdom from cache-file, must be called with fftw_planner_lock held */
+static int wisdom_load (const unsigned int min_part, const unsigned int max_part) {
+	char path[1024];
+	if (wisdom_path (path, sizeof (path), min_part, max_part)) {
+		return -1;
+	}
+	if (access (path, R_OK) || !fftwf_import_wisdom_from_filename (path)) {
+		return -1;
+	}
+	return 0;
+}
+
+/** save accumulated wisdom, must be called with fftw_planner_lock held */
+static void wisdom_save (const unsigned int min_part, const unsigned int max_part) {
+	char path[1024], tmp[1100];
+	if (wisdom_path (path, sizeof (path), min_part, max_part)) {
+		return;
+	}
+	snprintf (tmp, sizeof (tmp), "%s.%d", path, (int) getpid ());
+	if (!fftwf_export_wisdom_to_filename (tmp) || rename (tmp, path)) {
+		unlink (tmp);
+	}
+}
+#endif
+
+/** free IR file buffer returned by audiofile_read() */
+static void audiofile_free (float *buf, size_t map_len) {
+#ifndef _WIN32
+	if (buf && map_len > 0) {
+		munmap ((char*) buf - sizeof (SRCCacheHeader), map_len);
+		return;
+	}
+#endif
+	free (buf);
+}
+
+/** read an audio-file completely into memory
+ * allocated memory needs to be released by caller using audiofile_free()
+ *
+ * If use_cache is set and the file needs to be resampled, the resampled
+ * data is kept in the per-user cache-directory and memory-mapped
+ * (map_len > 0) when it is read the next time.
+ */
+static int audiofile_read (const char *fn, const int sample_rate, const int use_cache, float **buf, size_t *map_len, unsigned int *n_ch, unsigned int *n_sp) {
+	SF_INFO nfo;
+	SNDFILE  *sndfile;
+	float resample_ratio = 1.0;
+#ifndef _WIN32
+	uint64_t hash = 0;
+	bool hashed = false;
+#endif
+
+	*map_len = 0;
+
+	memset(&nfo, 0, sizeof(SF_INFO));
+
+	if ((sndfile = sf_open(fn, SFM_READ, &nfo)) == 0) {
+		return -1;
+	}
+
+	if (n_ch) *n_ch = (unsigned int) nfo.channels;
+	if (n_sp) *n_sp = (unsigned int) nfo.frames;
+
+	if (sample_rate != nfo.samplerate) {
+		fprintf(stderr, "convoLV2: samplerate mismatch file:%d host:%d\n", nfo.samplerate, sample_rate);
+		resample_ratio = (float) sample_rate / (float) nfo.samplerate;
+	}
+
+#ifndef _WIN32
+	if (buf && use_cache && resample_ratio != 1.0 && file_hash (fn, &hash) == 0) {
+		hashed = true;
+		if (src_cache_load (hash, sample_rate, nfo.channels, buf, map_len, n_sp) == 0) {
+			VERBOSE_printf("convoLV2: using cached resampled IR.\n");
+			sf_close (sndfile);
+			return (0);
+		}
+	}
+#endif
+
+	if (buf) {
+		const size_t frames_in = nfo.channels * nfo.frames;
+		const size_t frames_out = nfo.channels * ceil(nfo.frames * resample_ratio);
+		sf_count_t rd;
+		float *rdb;
+		*buf = (float*) malloc(frames_out*sizeof(float));
+
+		if (!*buf) {
+			fprintf (stderr, "convoLV2: memory allocation failed for IR audio-file buffer.\n");
+			sf_close (sndfile);
+			return (-2);
+		}
+
+		if (resample_ratio == 1.0) {
+			rdb = *buf;
+		} else {
+			rdb = (float*) malloc(frames_in*sizeof(float));
+			if (!rdb) {
+				fprintf (stderr, "convoLV2: memory allocation failed for IR resample buffer.\n");
+				sf_close (sndfile);
+				free(*buf);
+				return -1;
+			}
+		}
+
+		if(nfo.frames != (rd=sf_readf_float(sndfile, rdb, nfo.frames))) {
+			fprintf(stderr, "convoLV2: IR short read %ld of %ld\n", (long int) rd, (long int) nfo.frames);
+			free(*buf);
+			if (resample_ratio != 1.0) {
+				free(rdb);
+			}
+			sf_close (sndfile);
+			return -3;
+		}
+
+		if (resample_ratio != 1.0) {
+			VERBOSE_printf("convoLV2: resampling IR %ld -> %ld [frames * channels].\n",
+					(long int) frames_in,
+					(long int) frames_out);
+			SRC_STATE* src_state = src_new(SRC_QUALITY, nfo.channels, NULL);
+			SRC_DATA src_data;
+
+			src_data.input_frames  = nfo.frames;
+			src_data.output_frames = nfo.frames * resample_ratio;
+			src_data.end_of_input  = 1;
+			src_data.src_ratio     = resample_ratio;
+			src_data.input_frames_used = 0;
+			src_data.output_frames_gen = 0;
+			src_data.data_in       = rdb;
+			src_data.data_out      = *buf;
+			src_process(src_state, &src_data);
+			VERBOSE_printf("convoLV2: resampled IR  %ld -> %ld [frames * channels].\n",
+					src_data.input_frames_used * nfo.channels,
+					src_data.output_frames_gen * nfo.channels);
+
+			if (n_sp) *n_sp = (unsigned int) src_data.output_frames_gen;
+			free(rdb);
+			src_delete  (src_state);
+#ifndef _WIN32
+			if (hashed) {
+				src_cache_store (hash, sample_rate, nfo.channels, *buf, src_data.output_frames_gen);
+			}
+#endif
+		}
+	}
+
+	sf_close (sndfile);
+	return (0);
+}
+
+/** look up the channel-count and length of a cached IR file */
+static int ir_cache_probe (const char *path, const time_t mtime, const unsigned int rate, unsigned int *n_chan, unsigned int *n_frames) {
+	IRCacheEntry *e;
+	int rv = 0;
+	pthread_mutex_lock (&ir_cache_lock);
+	for (e = ir_cache; e; e = e->next) {
+		if (e->mtime == mtime && e->rate == rate && !strcmp (e->path, path)) {
+			*n_chan = e->n_chan;
+			*n_frames = e->n_frames;
+			rv = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&ir_cache_lock);
+	return rv;
+}
+
+static IRCacheEntry *ir_cache_find (const char *path, const time_t mtime, const unsigned int rate,
+		const unsigned int chan, const float gain, const unsigned int delay) {
+	IRCacheEntry *e;
+	for (e = ir_cache; e; e = e->next) {
+		if (e->mtime == mtime && e->rate == rate && e->chan == chan
+				&& e->gain == gain && e->delay == delay && !strcmp (e->path, path)) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/** get a reference to cached IR data, NULL if not cached */
+static IRCacheEntry *ir_cache_ref (const char *path, const time_t mtime, const unsigned int rate,
+		const unsigned int chan, const float gain, const unsigned int delay) {
+	IRCacheEntry *e;
+	pthread_mutex_lock (&ir_cache_lock);
+	if ((e = ir_cache_find (path, mtime, rate, chan, gain, delay))) {
+		++e->refcnt;
+	}
+	pthread_mutex_unlock (&ir_cache_lock);
+	return e;
+}
+
+/** add IR data to the cache, the cache takes ownership of data
+ * @return reference to the cache entry or NULL on error (data is free()ed)
+ */
+static IRCacheEntry *ir_cache_add (const char *path, const time_t mtime, const unsigned int rate,
+		const unsigned int chan, const float gain, const unsigned int delay,
+		const unsigned int n_chan, const unsigned int n_frames, float *data) {
+	IRCacheEntry *e;
+	pthread_mutex_lock (&ir_cache_lock);
+	if ((e = ir_cache_find (path, mtime, rate, chan, gain, delay))) {
+		/* added concurrently by another instance */
+		++e->refcnt;
+		free (data);
+	} else if ((e = (IRCacheEntry*) calloc (1, sizeof (IRCacheEntry))) && (e->path = strdup (path))) {
+		e->mtime = mtime;
+		e->rate = rate;
+		e->chan = chan;
+		e->gain = gain;
+		e->delay = delay;
+		e->n_chan = n_chan;
+		e->n_frames = n_frames;
+		e->data = data;
+		e->refcnt = 1;
+		e->next = ir_cache;
+		ir_cache = e;
+	} else {
+		free (e);
+		free (data);
+		e = NULL;
+	}
+	pthread_mutex_unlock (&ir_cache_lock);
+	return e;
+}
+
+/** drop a reference, free the data when it is no longer used */
+static void ir_cache_unref (IRCacheEntry *ref) {
+	IRCacheEntry *e, *p = NULL;
+	if (!ref) return;
+	pthread_mutex_lock (&ir_cache_lock);
+	for (e = ir_cache; e; p = e, e = e->next) {
+		if (e != ref) continue;
+		if (--e->refcnt == 0) {
+			if (p) {
+				p->next = e->next;
+			} else {
+				ir_cache = e->next;
+			}
+			free (e->path);
+			free (e->data);
+			free (e);
+		}
+		break;
+	}
+	pthread_mutex_unlock (&ir_cache_lock);
+}
+
+LV2convolv *clv_alloc() {
+	int i;
+	LV2convolv *clv = (LV2convolv*) calloc(1, sizeof(LV2convolv));
+	if (!clv) {
+		return NULL;
+	}
+
+	clv->engine = NULL;
+	for (i = 0; i < MAX_CHANNEL_MAPS; ++i) {
+		clv->ir_chan[i]  = i + 1;
+		clv->chn_inp[i]  = 0;
+		clv->chn_out[i]  = 0;
+		clv->ir_delay[i] = 0;
+		clv->ir_gain[i]  = 0.5f;
+		clv->mix_gain_set[i] = 1.f;
+		clv->mix_delay_set[i] = 0;
+	}
+	clv->ir_fn = NULL;
+	clv->engine_type = CLV_ENGINE_ZITA;
+	clv->ir_trim = 0.f;
+	clv->density = 0.f;
+	clv->size = 0x00100000;
+	clv->nonuniform = 0;
+	clv->max_part = Convproc::MAXPART;
+	clv->threaded = 0;
+	clv->thread_policy = -1;
+	clv->thread_prio = 0;
+	clv->rt_policy = SCHED_OTHER;
+	clv->rt_prio = 0;
+	clv->standby_enable = 0;
+	clv->bypass = 1;
+	clv->n_programs = 0;
+	clv->program = 0;
+	memset (clv->bank_fn, 0, sizeof (clv->bank_fn));
+	clv->bank_dir = NULL;
+	clv->bank_fade = 20;
+	clv->rr_factor = 1;
+	clv->rr_split = 8192;
+	clv->compact = 0;
+	clv->compact_split = 8192;
+	clv->mix = 0;
+	clv->mix_delay_max = 48000;
+	clv->rr_engine = NULL;
+	clv->abort_cb = NULL;
+	clv->abort_arg = NULL;
+	clv->mlock = 0;
+	clv->locked = 0;
+	clv->dsp = dsp_select ();
+	return clv;
+}
+
+static void fir_free (LV2convolv *clv) {
+	unsigned int c;
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		free (clv->fir_coef[c]);
+		clv->fir_coef[c] = NULL;
+	}
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (clv->fir_hist[c]);
+		free (clv->fir_out[c]);
+		clv->fir_hist[c] = clv->fir_out[c] = NULL;
+	}
+	clv->fir_len = 0;
+}
+
+static void rb_free (LV2convolv *clv) {
+	unsigned int c;
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (clv->rb_inp[c]);
+		free (clv->rb_out[c]);
+		clv->rb_inp[c] = clv->rb_out[c] = NULL;
+	}
+	clv->rebuffered = 0;
+}
+
+static void rr_free (LV2convolv *clv) {
+	unsigned int c;
+	if (clv->rr_engine) {
+		clv->rr_engine->stop ();
+		pthread_mutex_lock(&fftw_planner_lock);
+		delete (clv->rr_engine);
+		pthread_mutex_unlock(&fftw_planner_lock);
+	}
+	clv->rr_engine = NULL;
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (clv->rr_dec[c]);
+		free (clv->rr_int[c]);
+		free (clv->rr_out[c]);
+		clv->rr_dec[c] = clv->rr_int[c] = clv->rr_out[c] = NULL;
+	}
+	free (clv->rr_coef);
+	free (clv->rr_tmp);
+	clv->rr_coef = clv->rr_tmp = NULL;
+}
+
+/* Route mixer.
+ *
+ * Every route is convolved to a separate engine output, which is written
+ * to a delay line. The delayed routes are summed to the outputs, gain
+ * changes are ramped linearly over 20ms. Gain and delay changes do not need
+ * a new engine: the control thread stores them in a per-route slot and sets
+ * the route's bit in an atomic dirty mask. clv_convolve() collects the mask
+ * once per fragment and applies only the latest value of each route.
+ */
+
+static void mix_free (LV2convolv *clv) {
+	unsigned int c;
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		free (clv->mix_line[c]);
+		clv->mix_line[c] = NULL;
+	}
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (clv->mix_out[c]);
+		clv->mix_out[c] = NULL;
+	}
+	clv->mix_n_routes = 0;
+}
+
+/** assign an engine output to every route, allocate the delay lines */
+static int mix_setup (LV2convolv *clv, const unsigned int sample_rate, int *mix_index) {
+	unsigned int c, len;
+	const unsigned int n = clv->fragment_size;
+
+	clv->mix_n_routes = 0;
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		mix_index[c] = -1;
+		if (!clv->prog[0].ir_data[c]) {
+			continue;
+		}
+		mix_index[c] = clv->mix_n_routes;
+		clv->mix_route[clv->mix_n_routes++] = c;
+	}
+
+	/* the delay line holds the current fragment and the longest delay */
+	for (len = n; len < clv->mix_delay_max + n; len <<= 1) ;
+	clv->mix_mask = len - 1;
+	clv->mix_wpos = 0;
+	for (c = 0; c < clv->mix_n_routes; ++c) {
+		if (!(clv->mix_line[c] = (float*) malloc (len * sizeof (float)))) {
+			return -1;
+		}
+		thp_advise (clv->mix_line[c], len * sizeof (float));
+		memset (clv->mix_line[c], 0, len * sizeof (float));
+	}
+	for (c = 0; c < clv->n_out; ++c) {
+		if (!(clv->mix_out[c] = (float*) calloc (n, sizeof (float)))) {
+			return -1;
+		}
+	}
+
+	/* start with the values set so far, without a ramp */
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		const unsigned int d = clv->mix_delay_set[c] < clv->mix_delay_max ? clv->mix_delay_set[c] : clv->mix_delay_max;
+		clv->mix_gain[c] = clv->mix_target[c] = clv->mix_gain_set[c];
+		clv->mix_delay[c] = clv->mix_delay_prev[c] = d;
+		clv->mix_ramp[c] = 0;
+	}
+	__atomic_store_n (&clv->mix_dirty, 0, __ATOMIC_RELAXED);
+
+	/* gain changes: linear ramp of 20ms */
+	clv->mix_ramp_len = .02f * sample_rate;
+
+	VERBOSE_printf("convoLV2: route mixer: %u routes, max. delay %u samples\n", clv->mix_n_routes, clv->mix_delay_max);
+	return 0;
+}
+
+/** pick up the latest values of the routes that were set since the last fragment,
+ * called by the process thread. Repeated changes within one period are coalesced */
+static void mix_update (LV2convolv *clv) {
+	uint64_t dirty = __atomic_exchange_n (&clv->mix_dirty, 0, __ATOMIC_ACQUIRE);
+	while (dirty) {
+		const unsigned int r = __builtin_ctzll (dirty);
+		float gain;
+		dirty &= dirty - 1;
+		__atomic_load (&clv->mix_gain_set[r], &gain, __ATOMIC_RELAXED);
+		if (gain != clv->mix_target[r]) {
+			clv->mix_target[r] = gain;
+			clv->mix_ramp[r] = clv->mix_ramp_len;
+		}
+		clv->mix_delay[r] = __atomic_load_n (&clv->mix_delay_set[r], __ATOMIC_RELAXED);
+	}
+}
+
+/** add one fragment of delay line e, delayed by the given number of samples, with a gain ramp */
+static void mix_tap (LV2convolv *clv, float *out, const unsigned int e, const unsigned int delay,
+		const float gain, const float gain_step)
+{
+	const unsigned int n = clv->fragment_size;
+	const unsigned int len = clv->mix_mask + 1;
+	const unsigned int rp = (clv->mix_wpos + len - delay) & clv->mix_mask;
+	const unsigned int n1 = len - rp < n ? len - rp : n;
+	clv->dsp->mix_output (out, clv->mix_line[e] + rp, n1, gain, gain_step);
+	if (n1 < n) {
+		clv->dsp->mix_output (out + n1, clv->mix_line[e], n - n1, gain + n1 * gain_step, gain_step);
+	}
+}
+
+/** mix the engine's output of one fragment to mix_out[].
+ * A delay change is crossfaded over the fragment */
+static void mix_fragment (LV2convolv *clv) {
+	unsigned int c, e;
+	const unsigned int n = clv->fragment_size;
+
+	mix_update (clv);
+
+	for (c = 0; c < clv->n_out; ++c) {
+		memset (clv->mix_out[c], 0, n * sizeof (float));
+	}
+	for (e = 0; e < clv->mix_n_routes; ++e) {
+		const unsigned int r = clv->mix_route[e];
+		float *out = clv->mix_out[clv->chn_out[r] - 1];
+		memcpy (clv->mix_line[e] + clv->mix_wpos, clv->engine->outdata (e), n * sizeof (float));
+
+		const float g0 = clv->mix_gain[r];
+		float g1 = clv->mix_target[r];
+		if (clv->mix_ramp[r] > n) {
+			g1 = g0 + (g1 - g0) * n / clv->mix_ramp[r];
+			clv->mix_ramp[r] -= n;
+		} else {
+			clv->mix_ramp[r] = 0;
+		}
+		clv->mix_gain[r] = g1;
+
+		if (clv->mix_delay[r] != clv->mix_delay_prev[r]) {
+			mix_tap (clv, out, e, clv->mix_delay_prev[r], g0, -g0 / n);
+			mix_tap (clv, out, e, clv->mix_delay[r], 0.f, g1 / n);
+			clv->mix_delay_prev[r] = clv->mix_delay[r];
+		} else if (g0 != 0.f || g1 != 0.f) {
+			mix_tap (clv, out, e, clv->mix_delay[r], g0, (g1 - g0) / n);
+		}
+	}
+	clv->mix_wpos = (clv->mix_wpos + n) & clv->mix_mask;
+}
+
+/** call fn for the large buffers of the engines and the route mixer */
+static void clv_buffers (LV2convolv *clv, void (*fn) (void *p, size_t len, void *arg), void *arg) {
+	unsigned int e;
+	if (clv->engine) {
+		clv->engine->buffers (fn, arg);
+	}
+	if (clv->rr_engine) {
+		clv->rr_engine->buffers (fn, arg);
+	}
+	for (e = 0; e < clv->mix_n_routes; ++e) {
+		fn (clv->mix_line[e], (clv->mix_mask + 1) * sizeof (float), arg);
+	}
+}
+
+typedef struct {
+	size_t locked; ///< bytes
+	size_t failed; ///< bytes
+	int err; ///< errno of the last failure
+} MemLock;
+
+static void buf_prefault (void *p, size_t len, void *) {
+	prefault (p, len);
+}
+
+static void buf_lock (void *p, size_t len, void *arg) {
+	MemLock *ml = (MemLock*) arg;
+#ifndef _WIN32
+	if (mlock (p, len) == 0) {
+		ml->locked += len;
+		return;
+	}
+	ml->err = errno;
+#endif
+	ml->failed += len;
+}
+
+static void buf_unlock (void *p, size_t len, void *) {
+#ifndef _WIN32
+	munlock (p, len);
+#endif
+}
+
+/** unlock the buffers locked by clv_warmup(), before they are freed */
+static void mem_unlock (LV2convolv *clv) {
+	if (clv->locked) {
+		clv_buffers (clv, buf_unlock, NULL);
+		clv->locked = 0;
+	}
+}
+
+static void prog_release (LV2convolv *clv) {
+	unsigned int c, k;
+	for (k = 0; k < MAX_PROGRAMS; ++k) {
+		for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+			ir_cache_unref (clv->prog[k].ir_data[c]);
+			clv->prog[k].ir_data[c] = NULL;
+		}
+	}
+	clv->n_programs = 0;
+}
+
+void clv_release (LV2convolv *clv) {
+	if (!clv) return;
+	mem_unlock (clv);
+	if (clv->engine) {
+		clv->engine->stop ();
+		/* destroys FFTW plans */
+		pthread_mutex_lock(&fftw_planner_lock);
+		delete (clv->engine);
+		pthread_mutex_unlock(&fftw_planner_lock);
+	}
+	clv->engine = NULL;
+	fir_free (clv);
+	rb_free (clv);
+	rr_free (clv);
+	mix_free (clv);
+	prog_release (clv);
+}
+
+void clv_clone_settings(LV2convolv *clv_new, LV2convolv *clv) {
+	unsigned int i;
+	if (!clv) return;
+	memcpy (clv_new, clv, sizeof(LV2convolv));
+	clv_new->engine = NULL;
+	memset (clv_new->prog, 0, sizeof (clv_new->prog));
+	memset (clv_new->fir_coef, 0, sizeof (clv_new->fir_coef));
+	memset (clv_new->fir_hist, 0, sizeof (clv_new->fir_hist));
+	memset (clv_new->fir_out, 0, sizeof (clv_new->fir_out));
+	clv_new->fir_len = 0;
+	clv_new->rebuffered = 0;
+	memset (clv_new->rb_inp, 0, sizeof (clv_new->rb_inp));
+	memset (clv_new->rb_out, 0, sizeof (clv_new->rb_out));
+	clv_new->rr_engine = NULL;
+	clv_new->rr_coef = clv_new->rr_tmp = NULL;
+	memset (clv_new->rr_dec, 0, sizeof (clv_new->rr_dec));
+	memset (clv_new->rr_int, 0, sizeof (clv_new->rr_int));
+	memset (clv_new->rr_out, 0, sizeof (clv_new->rr_out));
+	memset (clv_new->mix_line, 0, sizeof (clv_new->mix_line));
+	memset (clv_new->mix_out, 0, sizeof (clv_new->mix_out));
+	clv_new->mix_n_routes = 0;
+	for (i = 0; i < MAX_CHANNEL_MAPS; ++i) {
+		/* the source may be processing */
+		__atomic_load (&clv->mix_gain_set[i], &clv_new->mix_gain_set[i], __ATOMIC_RELAXED);
+		clv_new->mix_delay_set[i] = __atomic_load_n (&clv->mix_delay_set[i], __ATOMIC_RELAXED);
+	}
+	clv_new->mix_dirty = 0;
+	clv_new->standby = 0;
+	clv_new->draining = 0;
+	clv_new->n_late = clv_new->n_load = clv_new->n_bypass = 0;
+	clv_new->n_periods = 0;
+	clv_new->first_time = clv_new->sum_time = 0;
+	clv_new->locked = 0;
+	clv_new->silent_len = 0;
+	clv_new->n_programs = 0;
+	if (clv->ir_fn) {
+		clv_new->ir_fn = strdup (clv->ir_fn);
+	}
+	for (unsigned int k = 0; k < MAX_PROGRAMS; ++k) {
+		if (clv->bank_fn[k]) {
+			clv_new->bank_fn[k] = strdup (clv->bank_fn[k]);
+		}
+	}
+	if (clv->bank_dir) {
+		clv_new->bank_dir = strdup (clv->bank_dir);
+	}
+}
+
+void clv_free (LV2convolv *clv) {
+	if (!clv) return;
+	clv_release (clv);
+	free (clv->ir_fn);
+	for (unsigned int k = 0; k < MAX_PROGRAMS; ++k) {
+		free (clv->bank_fn[k]);
+	}
+	free (clv->bank_dir);
+	free (clv);
+}
+
+int clv_configure (LV2convolv *clv, const char *key, const char *value) {
+	if (!clv) return 0;
+	int n;
+	if (strcasecmp (key, "convolution.ir.file") == 0) {
+		free(clv->ir_fn);
+		clv->ir_fn = strdup(value);
+	} else if (!strncasecmp (key, "convolution.bank.", 17)) {
+		if (strcasecmp (key, "convolution.bank.dir") == 0) {
+			free (clv->bank_dir);
+			clv->bank_dir = *value ? strdup (value) : NULL;
+		} else if (strcasecmp (key, "convolution.bank.fade") == 0) {
+			const int ms = atoi(value);
+			if (ms >= 0 && ms <= 10000) {
+				clv->bank_fade = ms;
+			} else {
+				fprintf (stderr, "convoLV2: invalid program crossfade length (%d ms)\n", ms);
+			}
+		} else if (sscanf (key, "convolution.bank.%d", &n) == 1) {
+			if ((0 < n) && (n < MAX_PROGRAMS)) {
+				free (clv->bank_fn[n]);
+				clv->bank_fn[n] = *value ? strdup (value) : NULL;
+			}
+		} else {
+			return 0;
+		}
+	} else if (!strncasecmp (key, "convolution.mix", 15)) {
+		if (strcasecmp (key, "convolution.mix") == 0) {
+			clv->mix = atoi(value) ? 1 : 0;
+		} else if (strcasecmp (key, "convolution.mix.delay.max") == 0) {
+			const int d = atoi(value);
+			if (d >= 0 && d <= 0x100000) {
+				clv->mix_delay_max = d;
+			} else {
+				fprintf (stderr, "convoLV2: invalid maximum route delay (%d)\n", d);
+			}
+		} else if (sscanf (key, "convolution.mix.gain.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
+				clv->mix_gain_set[n] = atof(value);
+		} else if (sscanf (key, "convolution.mix.delay.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS)) {
+				const int d = atoi(value);
+				clv->mix_delay_set[n] = d > 0 ? d : 0;
+			}
+		} else {
+			return 0;
+		}
+	} else if (strcasecmp (key, "convolution.program") == 0) {
+		const int prog = atoi(value);
+		clv->program = (prog >= 0 && prog < MAX_PROGRAMS) ? prog : 0;
+	} else if (strcasecmp (key, "convolution.matrix") == 0) {
+		clv->custom_map = strcasecmp (value, "custom") ? 0 : 1;
+	} else if (!strncasecmp (key, "convolution.source.", 19)) {
+		if (sscanf (key, "convolution.source.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
+				clv->chn_inp[n] = atoi(value);
+		}
+	} else if (!strncasecmp (key, "convolution.output.", 19)) {
+		if (sscanf (key, "convolution.output.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
+				clv->chn_out[n] = atoi(value);
+		}
+	} else if (!strncasecmp (key, "convolution.ir.channel.", 23)) {
+		if (sscanf (key, "convolution.ir.channel.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
+				clv->ir_chan[n] = atoi(value);
+		}
+	} else if (!strncasecmp (key, "convolution.ir.gain.", 20)) {
+		if (sscanf (key, "convolution.ir.gain.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
+				clv->ir_gain[n] = atof(value);
+		}
+	} else if (!strncasecmp (key, "convolution.ir.delay.", 21)) {
+		if (sscanf (key, "convolution.ir.delay.%d", &n) == 1) {
+			if ((0 <= n) && (n < MAX_CHANNEL_MAPS))
+				clv->ir_delay[n] = atoi(value);
+		}
+	} else if (strcasecmp (key, "convolution.ir.trim") == 0) {
+		const float db = atof(value);
+		if (db >= -200.f && db <= 0.f) {
+			clv->ir_trim = db;
+		} else {
+			fprintf (stderr, "convoLV2: invalid IR trim threshold (%f dB)\n", db);
+		}
+	} else if (strcasecmp (key, "convolution.ir.cache") == 0) {
+		clv->ir_disk_cache = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.engine") == 0) {
+		if (!strcasecmp (value, "zita")) {
+			clv->engine_type = CLV_ENGINE_ZITA;
+		} else if (!strcasecmp (value, "native")) {
+			clv->engine_type = CLV_ENGINE_NATIVE;
+		} else {
+			return 0;
+		}
+	} else if (strcasecmp (key, "convolution.maxsize") == 0) {
+		clv->size = atoi(value);
+		if (clv->size > 0x00400000) {
+			clv->size = 0x00400000;
+		}
+		if (clv->size < 0x00001000) {
+			clv->size = 0x00001000;
+		}
+	} else if (strcasecmp (key, "convolution.density") == 0) {
+		const float d = atof(value);
+		if (d >= 0.f && d <= 1.f) {
+			clv->density = d;
+		} else {
+			fprintf (stderr, "convoLV2: invalid density (%f)\n", d);
+		}
+	} else if (strcasecmp (key, "convolution.partitioning") == 0) {
+		if (!strcasecmp (value, "uniform")) {
+			clv->nonuniform = 0;
+		} else if (!strcasecmp (value, "non-uniform")) {
+			clv->nonuniform = 1;
+		} else {
+			return 0;
+		}
+	} else if (strcasecmp (key, "convolution.partition.max") == 0) {
+		unsigned int mp = Convproc::MINPART;
+		// round down to power of two
+		while (mp < Convproc::MAXPART && (mp << 1) <= (unsigned int) atoi(value)) {
+			mp <<= 1;
+		}
+		clv->max_part = mp;
+	} else if (strcasecmp (key, "convolution.hybrid") == 0) {
+		clv->hybrid = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.hybrid.head") == 0) {
+		const int n = atoi(value);
+		clv->hybrid_head = n > 0 ? n : 0;
+	} else if (strcasecmp (key, "convolution.tail.factor") == 0) {
+		const int f = atoi(value);
+		if (f == 1 || f == 2 || f == 4) {
+			clv->rr_factor = f;
+		} else {
+			fprintf (stderr, "convoLV2: invalid tail decimation factor (%d)\n", f);
+		}
+	} else if (strcasecmp (key, "convolution.tail.split") == 0) {
+		const int n = atoi(value);
+		clv->rr_split = n > 0 ? n : 0;
+	} else if (strcasecmp (key, "convolution.compact") == 0) {
+		clv->compact = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.compact.split") == 0) {
+		const int n = atoi(value);
+		clv->compact_split = n > 0 ? n : 0;
+	} else if (strcasecmp (key, "convolution.mlock") == 0) {
+		clv->mlock = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.buffered") == 0) {
+		clv->buffered = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.ftz") == 0) {
+		clv->ftz = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.bypass") == 0) {
+		clv->bypass = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.standby") == 0) {
+		clv->standby_enable = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.crossfade") == 0) {
+		const int ms = atoi(value);
+		if (ms >= 0 && ms <= 10000) {
+			clv->crossfade = ms;
+		} else {
+			fprintf (stderr, "convoLV2: invalid crossfade length (%d ms)\n", ms);
+		}
+	} else if (strcasecmp (key, "convolution.fftw.wisdom") == 0) {
+		clv->fftw_wisdom = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.threaded") == 0) {
+		clv->threaded = atoi(value) ? 1 : 0;
+	} else if (strcasecmp (key, "convolution.thread.policy") == 0) {
+		if (!strcasecmp (value, "auto")) {
+			clv->thread_policy = -1;
+		} else if (!strcasecmp (value, "other")) {
+			clv->thread_policy = SCHED_OTHER;
+		} else if (!strcasecmp (value, "fifo")) {
+			clv->thread_policy = SCHED_FIFO;
+		} else if (!strcasecmp (value, "rr")) {
+			clv->thread_policy = SCHED_RR;
+		} else {
+			return 0;
+		}
+	} else if (strcasecmp (key, "convolution.thread.priority") == 0) {
+		clv->thread_prio = atoi(value);
+	} else {
+		return 0;
+	}
+	return 1; // OK
+}
+
+char *clv_dump_settings (LV2convolv *clv) {
+	if (!clv) return NULL;
+
+	int i;
+	size_t bank_len = clv->bank_dir ? strlen (clv->bank_dir) + 22 : 0; // 21 + s
+	for (i = 1; i < MAX_PROGRAMS; ++i) {
+		bank_len += clv->bank_fn[i] ? strlen (clv->bank_fn[i]) + 21 : 0; // 18 + d + s
+	}
+
+#define MAX_CFG_SIZE ( MAX_CHANNEL_MAPS * 240 + 800 + (clv->ir_fn ? strlen(clv->ir_fn) : 0) + bank_len )
+	size_t off = 0;
+	char *rv = (char*) malloc (MAX_CFG_SIZE * sizeof (char));
+#undef MAX_CFG_SIZE
+
+	off+= sprintf(rv + off, "convolution.matrix=%s\n", clv->custom_map ? "custom" : "auto"); // 26
+	for (i = 0; i < MAX_CHANNEL_MAPS; ++i) {
+		/* sparse: only routes in use and non-default settings */
+		if (!(clv->chn_inp[i] && clv->chn_out[i] && clv->ir_chan[i])
+				&& clv->ir_gain[i] == 0.5f && clv->ir_delay[i] == 0) {
+			continue;
+		}
+		// f=12 ; d= 3 ; v=10
+		off+= sprintf (rv + off, "convolution.ir.gain.%d=%e\n",    i, clv->ir_gain[i]); // 22 + d + f
+		off+= sprintf (rv + off, "convolution.ir.delay.%d=%d\n",   i, clv->ir_delay[i]);// 23 + d + v
+		off+= sprintf (rv + off, "convolution.ir.channel.%d=%d\n", i, clv->ir_chan[i]); // 25 + d + d
+		off+= sprintf (rv + off, "convolution.source.%d=%d\n",     i, clv->chn_inp[i]); // 21 + d + d
+		off+= sprintf (rv + off, "convolution.output.%d=%d\n",     i, clv->chn_out[i]); // 21 + d + d
+		/* the process thread may set them concurrently */
+		float mix_gain;
+		__atomic_load (&clv->mix_gain_set[i], &mix_gain, __ATOMIC_RELAXED);
+		const unsigned int mix_delay = __atomic_load_n (&clv->mix_delay_set[i], __ATOMIC_RELAXED);
+		if (mix_gain != 1.f || mix_delay != 0) {
+			off+= sprintf (rv + off, "convolution.mix.gain.%d=%e\n",  i, mix_gain);  // 22 + d + f
+			off+= sprintf (rv + off, "convolution.mix.delay.%d=%u\n", i, mix_delay); // 23 + d + v
+		}
+	}
+	for (i = 1; i < MAX_PROGRAMS; ++i) {
+		if (clv->bank_fn[i]) {
+			off+= sprintf (rv + off, "convolution.bank.%d=%s\n", i, clv->bank_fn[i]);
+		}
+	}
+	if (clv->bank_dir) {
+		off+= sprintf(rv + off, "convolution.bank.dir=%s\n", clv->bank_dir);
+	}
+	off+= sprintf(rv + off, "convolution.bank.fade=%u\n", clv->bank_fade);                // 27
+	off+= sprintf(rv + off, "convolution.engine=%s\n", clv->engine_type == CLV_ENGINE_NATIVE ? "native" : "zita"); // 26
+	off+= sprintf(rv + off, "convolution.maxsize=%u\n", clv->size);                         // 21 + v
+	off+= sprintf(rv + off, "convolution.density=%.3f\n", clv->density);                    // 26
+	off+= sprintf(rv + off, "convolution.ir.cache=%d\n", clv->ir_disk_cache);               // 23
+	off+= sprintf(rv + off, "convolution.ir.trim=%.1f\n", clv->ir_trim);                    // 27
+	off+= sprintf(rv + off, "convolution.partitioning=%s\n", clv->nonuniform ? "non-uniform" : "uniform"); // 37
+	off+= sprintf(rv + off, "convolution.partition.max=%u\n", clv->max_part);              // 27 + v
+	off+= sprintf(rv + off, "convolution.hybrid=%d\n", clv->hybrid);                        // 21
+	off+= sprintf(rv + off, "convolution.hybrid.head=%u\n", clv->hybrid_head);              // 25 + v
+	off+= sprintf(rv + off, "convolution.tail.factor=%u\n", clv->rr_factor);               // 26
+	off+= sprintf(rv + off, "convolution.tail.split=%u\n", clv->rr_split);                 // 24 + v
+	off+= sprintf(rv + off, "convolution.compact=%d\n", clv->compact);                      // 22
+	off+= sprintf(rv + off, "convolution.compact.split=%u\n", clv->compact_split);          // 27 + v
+	off+= sprintf(rv + off, "convolution.mix=%d\n", clv->mix);                              // 18
+	off+= sprintf(rv + off, "convolution.mix.delay.max=%u\n", clv->mix_delay_max);         // 27 + v
+	off+= sprintf(rv + off, "convolution.mlock=%d\n", clv->mlock);                          // 20
+	off+= sprintf(rv + off, "convolution.buffered=%d\n", clv->buffered);                    // 23
+	off+= sprintf(rv + off, "convolution.standby=%d\n", clv->standby_enable);               // 22
+	off+= sprintf(rv + off, "convolution.ftz=%d\n", clv->ftz);                              // 18
+	off+= sprintf(rv + off, "convolution.bypass=%d\n", clv->bypass);                        // 21
+	off+= sprintf(rv + off, "convolution.crossfade=%u\n", clv->crossfade);                  // 28
+	off+= sprintf(rv + off, "convolution.fftw.wisdom=%d\n", clv->fftw_wisdom);              // 26
+	off+= sprintf(rv + off, "convolution.threaded=%d\n", clv->threaded);                    // 23
+	off+= sprintf(rv + off, "convolution.thread.policy=%s\n",                               // 32
+			clv->thread_policy == SCHED_FIFO ? "fifo" :
+			clv->thread_policy == SCHED_RR ? "rr" :
+			clv->thread_policy == SCHED_OTHER ? "other" : "auto");
+	off+= sprintf(rv + off, "convolution.thread.priority=%d\n", clv->thread_prio);          // 29 + v
+	return rv;
+}
+
+int clv_query_setting (LV2convolv *clv, const char *key, char *value, size_t val_max_len) {
+	int rv = 0;
+	if (!clv || !value || !key) {
+		return -1;
+	}
+
+	if (strcasecmp (key, "convolution.ir.file") == 0) {
+		if (clv->ir_fn) {
+			if (strlen(clv->ir_fn) >= val_max_len) {
+				rv = -1;
+			}
+			else {
+				rv=snprintf(value, val_max_len, "%s", clv->ir_fn);
+			}
+		}
+	}
+	else if (strcasecmp (key, "convolution.engine") == 0) {
+		rv = snprintf(value, val_max_len, "%s", clv->engine ? clv->engine->name () :
+				clv->engine_type == CLV_ENGINE_NATIVE ? "native" : "zita");
+	}
+	else if (strcasecmp (key, "convolution.simd") == 0) {
+		rv = snprintf(value, val_max_len, "%s", clv->dsp->name);
+	}
+	else if (strcasecmp (key, "convolution.standby") == 0) {
+		rv = snprintf(value, val_max_len, "%d", clv->standby_enable);
+	}
+	else if (strcasecmp (key, "convolution.crossfade") == 0) {
+		rv = snprintf(value, val_max_len, "%u", clv->crossfade);
+	}
+	else if (strcasecmp (key, "convolution.ir.trim") == 0) {
+		rv = snprintf(value, val_max_len, "%.1f", clv->ir_trim);
+	}
+	else if (strcasecmp (key, "convolution.length") == 0) {
+		rv = snprintf(value, val_max_len, "%u", clv->tail_len);
+	}
+	else if (strcasecmp (key, "convolution.programs") == 0) {
+		rv = snprintf(value, val_max_len, "%u", clv->n_programs);
+	}
+	else if (strcasecmp (key, "convolution.program") == 0) {
+		rv = snprintf(value, val_max_len, "%u", clv->program);
+	}
+	else if (strcasecmp (key, "convolution.tail.split") == 0) {
+		/* 0 if the tail is not processed at reduced rate */
+		rv = snprintf(value, val_max_len, "%u", clv->rr_engine ? clv->rr_split : 0);
+	}
+	else if (strcasecmp (key, "convolution.hybrid.split") == 0) {
+		rv = snprintf(value, val_max_len, "%u", clv->fir_len);
+	}
+	else if (strcasecmp (key, "convolution.stats.late") == 0) {
+		rv = snprintf(value, val_max_len, "%lu", clv->n_late);
+	}
+	else if (strcasecmp (key, "convolution.stats.load") == 0) {
+		rv = snprintf(value, val_max_len, "%lu", clv->n_load);
+	}
+	else if (strcasecmp (key, "convolution.stats.bypass") == 0) {
+		rv = snprintf(value, val_max_len, "%lu", clv->n_bypass);
+	}
+	else if (strcasecmp (key, "convolution.stats.periods") == 0) {
+		rv = snprintf(value, val_max_len, "%lu", clv->n_periods);
+	}
+	else if (strcasecmp (key, "convolution.stats.first") == 0) {
+		/* ms */
+		rv = snprintf(value, val_max_len, "%.4f", clv->first_time);
+	}
+	else if (strcasecmp (key, "convolution.stats.average") == 0) {
+		/* ms */
+		rv = snprintf(value, val_max_len, "%.4f", clv->n_periods > 0 ? clv->sum_time / clv->n_periods : 0);
+	}
+	else if (strcasecmp (key, "convolution.stats.locked") == 0) {
+		/* bytes */
+		rv = snprintf(value, val_max_len, "%lu", (unsigned long) clv->locked);
+	}
+	// TODO allow querying other settings
+	return rv;
+}
+
+void clv_set_buffered (LV2convolv *clv, int buffered) {
+	if (!clv) return;
+	clv->host_buffered = buffered;
+}
+
+int clv_select_program (LV2convolv *clv, unsigned int program) {
+	if (!clv || !clv->engine || program >= clv->n_programs) {
+		return -1;
+	}
+	if (clv->engine->select_program (program, clv->bank_fade_len)) {
+		return -1;
+	}
+	clv->program = program;
+	return 0;
+}
+
+int clv_set_route_gain (LV2convolv *clv, unsigned int route, float gain) {
+	if (!clv || !clv->mix || route >= MAX_CHANNEL_MAPS) {
+		return -1;
+	}
+	__atomic_store (&clv->mix_gain_set[route], &gain, __ATOMIC_RELAXED);
+	__atomic_fetch_or (&clv->mix_dirty, 1ULL << route, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int clv_set_route_delay (LV2convolv *clv, unsigned int route, unsigned int delay) {
+	if (!clv || !clv->mix || route >= MAX_CHANNEL_MAPS || delay > clv->mix_delay_max) {
+		return -1;
+	}
+	__atomic_store_n (&clv->mix_delay_set[route], delay, __ATOMIC_RELAXED);
+	__atomic_fetch_or (&clv->mix_dirty, 1ULL << route, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void clv_set_abort_callback (LV2convolv *clv, int (*cb) (void *arg), void *arg) {
+	if (!clv) return;
+	clv->abort_cb = cb;
+	clv->abort_arg = arg;
+}
+
+void clv_set_standby (LV2convolv *clv, int standby) {
+	if (!clv) return;
+	clv->standby = standby;
+}
+
+double clv_process_time (LV2convolv *clv) {
+	if (!clv || !clv->engine) {
+		return 0;
+	}
+	return clv->proc_time;
+}
+
+unsigned int clv_fragment_size (LV2convolv *clv) {
+	if (!clv || !clv->engine) {
+		return 0;
+	}
+	return clv->fragment_size;
+}
+
+int clv_same_settings (LV2convolv *a, LV2convolv *b) {
+	int rv;
+	if (!a || !b || !a->ir_fn || !b->ir_fn || strcmp (a->ir_fn, b->ir_fn)) {
+		return 0;
+	}
+	char *sa = clv_dump_settings (a);
+	char *sb = clv_dump_settings (b);
+	rv = sa && sb && !strcmp (sa, sb);
+	free (sa);
+	free (sb);
+	return rv;
+}
+
+int clv_rebuffer (LV2convolv *clv) {
+	if (!clv || !clv->engine) {
+		return -1;
+	}
+	if (clv->buffered || clv->host_buffered || clv->rebuffered) {
+		return 0;
+	}
+	if (!clv->rb_inp[0] || clv->draining) {
+		return -1;
+	}
+	/* the output of the first fragment after the switch is silent */
+	for (unsigned int c = 0; c < clv->n_out; ++c) {
+		memset (clv->rb_out[c], 0, clv->fragment_size * sizeof (float));
+	}
+	clv->rb_pos = 0;
+	clv->rebuffered = 1;
+	return 0;
+}
+
+unsigned int clv_latency (LV2convolv *clv) {
+	if (!clv || !(clv->buffered || clv->host_buffered || clv->rebuffered)) {
+		return 0;
+	}
+	return clv->fragment_size;
+}
+
+void clv_set_thread_reference (LV2convolv *clv, int policy, int priority) {
+	if (!clv) return;
+	clv->rt_policy = policy;
+	clv->rt_prio = priority;
+}
+
+
+/** find the part of an IR that needs to be convolved.
+ * Leading and trailing zeros are skipped. If threshold_db < 0 the tail is cut where
+ * the energy decay curve (Schroeder backward integral) falls below the threshold
+ * relative to the total energy.
+ */
+static void ir_trim (const float *data, const unsigned int n_frames, const float threshold_db,
+		unsigned int *offset, unsigned int *length)
+{
+	unsigned int start = 0, end = n_frames;
+	double total = 0;
+	while (start < n_frames && data[start] == 0.f) {
+		++start;
+	}
+	while (end > start && data[end - 1] == 0.f) {
+		--end;
+	}
+	if (threshold_db < 0.f && end > start) {
+		unsigned int i;
+		for (i = start; i < end; ++i) {
+			total += data[i] * (double) data[i];
+		}
+		const double limit = total * pow (10., .1 * threshold_db);
+		double edc = 0;
+		for (i = end; i > start; --i) {
+			edc += data[i - 1] * (double) data[i - 1];
+			if (edc > limit) {
+				break;
+			}
+		}
+		end = i;
+	}
+	*offset = start;
+	*length = end - start;
+}
+
+/** split routes into FIR head and FFT part, allocate FIR buffers */
+static int fir_setup (LV2convolv *clv, const unsigned int head, const unsigned int max_size) {
+	unsigned int c, k;
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		if (!clv->prog[0].ir_data[c]) {
+			continue;
+		}
+		const unsigned int delay = clv->ir_delay[c];
+		const unsigned int k0 = delay + clv->prog[0].ir_offset[c];
+		unsigned int k1 = k0 + clv->prog[0].ir_length[c];
+		if (k1 > head) k1 = head;
+		if (k1 > max_size) k1 = max_size;
+		clv->fir_k0[c] = k0 < head ? k0 : head;
+		clv->fir_k1[c] = k1 > clv->fir_k0[c] ? k1 : clv->fir_k0[c];
+		if (clv->fir_k1[c] == clv->fir_k0[c]) {
+			continue;
+		}
+		if (!(clv->fir_coef[c] = (float*) calloc (head, sizeof (float)))) {
+			goto errout;
+		}
+		for (k = clv->fir_k0[c]; k < clv->fir_k1[c]; ++k) {
+			clv->fir_coef[c][k] = clv->prog[0].ir_data[c]->data[k - delay];
+		}
+	}
+	for (c = 0; c < clv->n_inp; ++c) {
+		if (!(clv->fir_hist[c] = (float*) calloc (head - 1 + clv->fragment_size, sizeof (float)))) {
+			goto errout;
+		}
+	}
+	for (c = 0; c < clv->n_out; ++c) {
+		if (!(clv->fir_out[c] = (float*) calloc (clv->fragment_size, sizeof (float)))) {
+			goto errout;
+		}
+	}
+	clv->fir_len = head;
+	return 0;
+
+errout:
+	fir_free (clv);
+	return -1;
+}
+
+/* Reduced-rate tail.
+ *
+ * The input is low-pass filtered and decimated, convolved with the decimated
+ * IR tail by a second engine, and interpolated. The filters and one period of
+ * the (buffered) tail engine delay the tail, which is compensated by shifting
+ * the decimated IR: the tail must start after that latency.
+ * The head of the IR is crossfaded with the tail over RR_TAPS * factor samples.
+ */
+#define RR_TAPS (64) ///< low-pass taps per polyphase branch
+
+/** Blackman windowed sinc of RR_TAPS * factor - 1 taps, unity gain at DC,
+ * stored as polyphase branches: coef[p * RR_TAPS + j] = h[j * factor + p] */
+static void rr_lowpass (float *coef, const unsigned int factor) {
+	double h[RR_TAPS * 4];
+	unsigned int k;
+	const unsigned int len = RR_TAPS * factor - 1;
+	const double c0 = (len - 1) / 2.;
+	const double fc = .5 / factor - 2.75 / len; // pass-band edge + half the transition band
+	double sum = 0;
+	for (k = 0; k < len; ++k) {
+		const double x = k - c0;
+		const double w = .42 - .5 * cos (2. * M_PI * k / (len - 1)) + .08 * cos (4. * M_PI * k / (len - 1));
+		h[k] = w * (x == 0 ? 2. * fc : sin (2. * M_PI * fc * x) / (M_PI * x));
+		sum += h[k];
+	}
+	h[len] = 0;
+	for (k = 0; k <= len; ++k) {
+		coef[(k % factor) * RR_TAPS + k / factor] = h[k] / sum;
+	}
+}
+
+/** find the period of the tail engine for the configured split.
+ * @return latency of the tail processing in samples, 0 if the tail can not be decimated */
+static unsigned int rr_plan (LV2convolv *clv, const unsigned int period, const unsigned int max_size) {
+	const unsigned int D = clv->rr_factor;
+	const unsigned int c0 = RR_TAPS * D / 2 - 1; // group delay of the low-pass
+	unsigned int part = Convproc::MINPART;
+
+	if (clv->buffered || clv->host_buffered || clv->n_programs > 1) {
+		VERBOSE_printf("convoLV2: reduced-rate tail is not supported with buffered processing or IR banks.\n");
+		return 0;
+	}
+	if (clv->rr_split + RR_TAPS * D >= max_size) {
+		VERBOSE_printf("convoLV2: IR is shorter than the tail split, processing at full rate.\n");
+		return 0;
+	}
+	if (clv->rr_split < 3 * c0 + part * D) {
+		VERBOSE_printf("convoLV2: tail split %u is too short for decimation by %u (min. %u).\n",
+				clv->rr_split, D, 3 * c0 + part * D);
+		return 0;
+	}
+
+	/* the tail, spread by the IR's low-pass, must start after the latency */
+	const unsigned int room = clv->rr_split + D - 2 - 3 * c0;
+	while (part < Convproc::MAXPART && (part << 1) * D <= room) {
+		part <<= 1;
+	}
+	if (part * D < period) {
+		VERBOSE_printf("convoLV2: tail split %u is too short for a period of %u samples.\n", clv->rr_split, period);
+		return 0;
+	}
+	clv->rr_part = part;
+	return 2 * c0 + part * D - (D - 1);
+}
+
+/** allocate the filters and configure the tail engine, called with fftw_planner_lock held */
+static int rr_configure (LV2convolv *clv, const unsigned int max_size, const unsigned int lat, const unsigned int options) {
+	unsigned int c;
+	const unsigned int D = clv->rr_factor;
+	const unsigned int c0 = RR_TAPS * D / 2 - 1;
+	const unsigned int n = clv->fragment_size / D;
+	const unsigned int rr_size = (max_size + c0 - lat) / D + 1;
+	int rv;
+
+	if (!(clv->rr_coef = (float*) malloc (RR_TAPS * D * sizeof (float)))
+			|| !(clv->rr_tmp = (float*) malloc (n * sizeof (float)))) {
+		return -1;
+	}
+	rr_lowpass (clv->rr_coef, D);
+
+	for (c = 0; c < clv->n_inp; ++c) {
+		if (!(clv->rr_dec[c] = (float*) calloc (D * (RR_TAPS - 1 + n), sizeof (float)))) {
+			return -1;
+		}
+	}
+	for (c = 0; c < clv->n_out; ++c) {
+		if (!(clv->rr_int[c] = (float*) calloc (RR_TAPS - 1 + n, sizeof (float)))
+				|| !(clv->rr_out[c] = (float*) calloc (clv->fragment_size, sizeof (float)))) {
+			return -1;
+		}
+	}
+
+	if (clv->engine_type == CLV_ENGINE_NATIVE) {
+		NativeEngine *ne = new NativeEngine (clv->dsp);
+		clv->rr_engine = ne;
+		rv = ne->configure (clv->n_inp, clv->n_out, rr_size, clv->rr_part, 1, 0, ~0u);
+	} else {
+		ZitaEngine *ze = new ZitaEngine (options);
+		clv->rr_engine = ze;
+		rv = ze->configure (clv->n_inp, clv->n_out, rr_size, clv->rr_part,
+				clv->nonuniform && clv->max_part > clv->rr_part ? clv->max_part : clv->rr_part, clv->density);
+	}
+	clv->rr_pos = 0;
+	return rv;
+}
+
+/** low-pass filter and decimate the tail of every route, and pass it to the tail engine.
+ * Tap i of the decimated IR is the IR at lat + i * factor */
+static int rr_load (LV2convolv *clv, const unsigned int max_size, const unsigned int lat) {
+	unsigned int c, i, k;
+	const unsigned int D = clv->rr_factor;
+	const unsigned int len = RR_TAPS * D - 1;
+	const unsigned int c0 = (len - 1) / 2;
+	const unsigned int split = clv->rr_split;
+	const unsigned int xover = RR_TAPS * D;
+	const IRProgram *prog = &clv->prog[0];
+	unsigned int n_taps = 0;
+
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		if (!prog->ir_data[c]) {
+			continue;
+		}
+		const float *data = prog->ir_data[c]->data;
+		const unsigned int delay = clv->ir_delay[c];
+		unsigned int r0 = delay + prog->ir_offset[c];
+		unsigned int r1 = r0 + prog->ir_length[c];
+		r0 = r0 > split ? r0 : split;
+		r1 = r1 < max_size ? r1 : max_size;
+		if (r1 <= r0) {
+			continue;
+		}
+		const unsigned int i0 = r0 > lat + c0 ? (r0 - c0 - lat + D - 1) / D : 0;
+		const unsigned int i1 = (r1 - 1 + c0 - lat) / D + 1;
+
+		float *g = (float*) malloc ((i1 - i0) * sizeof (float));
+		if (!g) {
+			return -1;
+		}
+		for (i = i0; i < i1; ++i) {
+			/* zero-phase low-pass of the tail, which fades in after the split */
+			const unsigned int m = lat + i * D + c0;
+			double acc = 0;
+			for (k = 0; k < len; ++k) {
+				const unsigned int t = m - k;
+				if (t < r0 || t >= r1) {
+					continue;
+				}
+				const double w = t < split + xover ? .5 - .5 * cos (M_PI * (t - split) / xover) : 1.;
+				acc += clv->rr_coef[(k % D) * RR_TAPS + k / D] * w * data[t - delay];
+			}
+			g[i - i0] = D * acc;
+		}
+		const int rv = clv->rr_engine->impdata_create (clv->chn_inp[c] - 1, clv->chn_out[c] - 1, g, i0, i1);
+		free (g);
+		if (rv) {
+			return -1;
+		}
+		n_taps += i1 - i0;
+	}
+
+	VERBOSE_printf("convoLV2: reduced-rate tail from sample %u: rate / %u, period %u, latency %u samples (compensated), %u taps\n",
+			split, D, clv->rr_part, lat, n_taps);
+	return 0;
+}
+
+/** checkpoint of clv_initialize(), @return 1 if the initialization is to be aborted */
+static int init_aborted (LV2convolv *clv) {
+	if (!clv->abort_cb || !clv->abort_cb (clv->abort_arg)) {
+		return 0;
+	}
+	VERBOSE_printf("convoLV2: initialization aborted.\n");
+	return 1;
+}
+
+/** decode the IR channel of every route, apply gain scaling and add it to the IR cache.
+ * p is the interleaved file data, it is read if needed (all routes may be cached).
+ * IR channels wrap around if the file has fewer channels than the routes use.
+ */
+static int ir_prepare (LV2convolv *clv, const char *fn, const time_t mtime, const unsigned int sample_rate,
+		float **p, size_t *p_map_len, const unsigned int n_chan, const unsigned int n_frames, IRProgram *prog)
+{
+	unsigned int c, i;
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		if (clv->chn_inp[c] == 0 || clv->chn_out[c] == 0 || clv->ir_chan[c] == 0) {
+			continue;
+		}
+
+		const unsigned int chan = 1 + (clv->ir_chan[c] - 1) % n_chan;
+
+		prog->ir_data[c] = ir_cache_ref (fn, mtime, sample_rate,
+				chan, clv->ir_gain[c], clv->ir_delay[c]);
+
+		if (prog->ir_data[c]) {
+			continue;
+		}
+
+		if (!*p) {
+			/* cache entries were released meanwhile */
+			unsigned int chk_chan, chk_frames;
+			if (audiofile_read (fn, sample_rate, clv->ir_disk_cache, p, p_map_len, &chk_chan, &chk_frames)) {
+				fprintf(stderr, "convoLV2: failed to read IR.\n");
+				return -1;
+			}
+			if (chk_chan != n_chan || chk_frames != n_frames) {
+				fprintf(stderr, "convoLV2: IR file was modified.\n");
+				return -1;
+			}
+		}
+
+		float *gb = (float*) malloc (n_frames * sizeof(float));
+		if (!gb) {
+			fprintf (stderr, "convoLV2: memory allocation failed for convolution buffer.\n");
+			return -1;
+		}
+
+		for (i = 0; i < n_frames; ++i) {
+			// decode interleaved channels, apply gain scaling
+			gb[i] = (*p)[i * n_chan + chan - 1] * clv->ir_gain[c];
+		}
+
+		/* gb is owned by cache */
+		prog->ir_data[c] = ir_cache_add (fn, mtime, sample_rate,
+				chan, clv->ir_gain[c], clv->ir_delay[c],
+				n_chan, n_frames, gb);
+
+		if (!prog->ir_data[c]) {
+			fprintf (stderr, "convoLV2: memory allocation failed for IR cache.\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int bank_file_cmp (const void *a, const void *b) {
+	return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/** IR files of the bank: the configured entries, or the first max_files audio files in bank_dir (sorted).
+ * files[N - 1] is program N, NULL for a gap in the configured entries.
+ * @return number of slots, the caller frees them */
+static unsigned int bank_files (LV2convolv *clv, char **files, const unsigned int max_files) {
+	unsigned int i, n = 0;
+	for (i = 1; i < MAX_PROGRAMS && i <= max_files; ++i) {
+		files[i - 1] = NULL;
+		if (clv->bank_fn[i]) {
+			files[i - 1] = strdup (clv->bank_fn[i]);
+			n = i;
+		}
+	}
+#ifndef _WIN32
+	if (n == 0 && clv->bank_dir) {
+		static const char *ext[] = { ".wav", ".flac", ".aif", ".aiff", ".caf", ".w64", ".rf64", ".ogg", NULL };
+		DIR *dir = opendir (clv->bank_dir);
+		struct dirent *de;
+		char **all = NULL;
+		unsigned int n_all = 0, n_alloc = 0;
+		if (!dir) {
+			fprintf (stderr, "convoLV2: cannot open IR bank directory: %s\n", clv->bank_dir);
+			return 0;
+		}
+		/* collect all files first, readdir() order is arbitrary */
+		while ((de = readdir (dir))) {
+			const char *dot = strrchr (de->d_name, '.');
+			for (i = 0; dot && ext[i]; ++i) {
+				if (!strcasecmp (dot, ext[i])) {
+					break;
+				}
+			}
+			if (!dot || !ext[i]) {
+				continue;
+			}
+			char *fn = (char*) malloc (strlen (clv->bank_dir) + strlen (de->d_name) + 2);
+			if (!fn) {
+				break;
+			}
+			sprintf (fn, "%s/%s", clv->bank_dir, de->d_name);
+			if (clv->ir_fn && !strcmp (fn, clv->ir_fn)) {
+				free (fn); // program 0
+				continue;
+			}
+			if (n_all == n_alloc) {
+				char **tmp = (char**) realloc (all, (n_alloc + 64) * sizeof (char*));
+				if (!tmp) {
+					free (fn);
+					break;
+				}
+				all = tmp;
+				n_alloc += 64;
+			}
+			all[n_all++] = fn;
+		}
+		closedir (dir);
+		if (n_all > 0) {
+			qsort (all, n_all, sizeof (char*), bank_file_cmp);
+		}
+		if (n_all > max_files) {
+			fprintf (stderr, "convoLV2: IR bank directory has %u files, only the first %u are loaded.\n", n_all, max_files);
+		}
+		for (i = 0; i < n_all; ++i) {
+			if (i < max_files) {
+				files[n++] = all[i];
+			} else {
+				free (all[i]);
+			}
+		}
+		free (all);
+	}
+#endif
+	return n;
+}
+
+/** load bank IRs as programs 1.., using the routes of program 0.
+ * Gaps and files that cannot be read are empty programs, which are silent.
+ * @return -1 on allocation failure, -2 if aborted */
+static int bank_load (LV2convolv *clv, const unsigned int sample_rate) {
+	char *files[MAX_PROGRAMS - 1];
+	unsigned int i;
+	int rv = 0;
+	const unsigned int n_files = bank_files (clv, files, MAX_PROGRAMS - 1);
+
+	for (i = 0; i < n_files; ++i) {
+		struct stat st;
+		unsigned int n_chan = 0, n_frames = 0;
+		float *p = NULL;
+		size_t p_map_len = 0;
+		if (rv) {
+			continue;
+		}
+		/* the program number is the slot, also when it stays empty */
+		clv->n_programs = i + 2;
+		if (!files[i]) {
+			VERBOSE_printf("convoLV2: program %u: empty\n", i + 1);
+			continue;
+		}
+		if (init_aborted (clv)) {
+			rv = -2;
+			continue;
+		}
+		if (access (files[i], R_OK) != 0 || stat (files[i], &st) != 0
+				|| (!ir_cache_probe (files[i], st.st_mtime, sample_rate, &n_chan, &n_frames)
+					&& audiofile_read (files[i], sample_rate, clv->ir_disk_cache, &p, &p_map_len, &n_chan, &n_frames))
+				|| n_chan == 0 || n_frames == 0) {
+			fprintf (stderr, "convoLV2: cannot read IR bank entry: %s, program %u is silent\n", files[i], i + 1);
+			audiofile_free (p, p_map_len);
+			continue;
+		}
+		if (ir_prepare (clv, files[i], st.st_mtime, sample_rate, &p, &p_map_len, n_chan, n_frames, &clv->prog[i + 1])) {
+			rv = -1;
+		} else {
+			VERBOSE_printf("convoLV2: program %u: %s (%u chn, %u samples)\n", i + 1, files[i], n_chan, n_frames);
+		}
+		audiofile_free (p, p_map_len);
+	}
+	for (i = 0; i < n_files; ++i) {
+		free (files[i]);
+	}
+	return rv;
+}
+
+/** assign IR channels to routes according to the channel map conventions */
+static void channel_map_conventions (LV2convolv *clv,
+		const unsigned int in_channel_cnt,
+		const unsigned int out_channel_cnt,
+		const unsigned int n_chan)
+{
+	unsigned int c;
+	unsigned int n_routes;
+	const unsigned int n_elem = in_channel_cnt * out_channel_cnt;
+
+	// reset channel map
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		clv->ir_chan[c] = 0;
+		clv->chn_inp[c] = 0;
+		clv->chn_out[c] = 0;
+	}
+
+	// follow channel map conventions
+	if (n_elem == n_chan) {
+		// exact match: for every input-channel, iterate over all outputs
+		// eg.  1: L -> L , 2: L -> R, 3: R -> L, 4: R -> R
+		n_routes = n_chan;
+		for (c = 0; c < n_routes && c < MAX_CHANNEL_MAPS; ++c) {
+			clv->ir_chan[c] = 1 + c;
+			clv->chn_inp[c] = 1 + ((c / out_channel_cnt) % in_channel_cnt);
+			clv->chn_out[c] = 1 +  (c % out_channel_cnt);
+		}
+	}
+	else if (n_elem > n_chan) {
+		VERBOSE_printf("convoLV2: IR file has too few channels for given processor config.\n");
+		// missing some channels, first assign  in -> out, then x-over
+		// eg.  1: L -> L , 2: R -> R,  3: L -> R,  4: R -> L
+		// this allows to e.g load a 2-channel (stereo) IR into a
+		// 2x2 true-stereo effect instance.
+		// The diagonal is always complete, IR channels wrap around:
+		// a mono IR is used for 1: L -> L , 2: R -> R,
+		const unsigned int n_diag = in_channel_cnt > out_channel_cnt ? in_channel_cnt : out_channel_cnt;
+		n_routes = n_chan > n_diag ? n_chan : n_diag;
+		for (c = 0; c < n_routes && c < MAX_CHANNEL_MAPS; ++c) {
+			const unsigned int d = c / n_diag; // offset from the diagonal
+			const unsigned int j = c % n_diag;
+			clv->ir_chan[c] = 1 + (c % n_chan);
+			clv->chn_inp[c] = 1 + (j % in_channel_cnt);
+			clv->chn_out[c] = 1 + ((j + d) % out_channel_cnt);
+		}
+	}
+	else {
+		assert (n_elem < n_chan);
+		VERBOSE_printf("convoLV2: IR file has too many channels for given processor config.\n");
+		// allow loading a quad file to a mono-in stereo-out
+		// eg.  1: L -> L , 2: L -> R
+		n_routes = n_elem;
+		for (c = 0; c < n_routes && c < MAX_CHANNEL_MAPS; ++c) {
+			clv->ir_chan[c] = 1 + c;
+			clv->chn_inp[c] = 1 + ((c / out_channel_cnt) % in_channel_cnt);
+			clv->chn_out[c] = 1 +  (c % out_channel_cnt);
+		}
+	}
+
+	if (n_routes > MAX_CHANNEL_MAPS) {
+		VERBOSE_printf("convoLV2: only the first %d of %d routes are used.\n", MAX_CHANNEL_MAPS, n_routes);
+	}
+}
+
+int clv_initialize (
+		LV2convolv *clv,
+		const unsigned int sample_rate,
+		const unsigned int in_channel_cnt,
+		const unsigned int out_channel_cnt,
+		const unsigned int buffersize)
+{
+	unsigned int c;
+
+	/* zita-conv settings */
+	unsigned int options = 0;
+	int policy = SCHED_OTHER;
+	int abspri = 0;
+
+	/* IR file */
+	unsigned int n_chan = 0;
+	unsigned int n_frames = 0;
+	unsigned int max_size = 0;
+	unsigned int full_size = 0; /* convolution length without trimming */
+	unsigned int n_part_full = 0, n_part_used = 0;
+	unsigned int max_part = buffersize;
+	unsigned int quantum = buffersize; /* engine period */
+	unsigned int eng_size; /* length processed by the main engine */
+	unsigned int rr_lat = 0; /* latency of the reduced-rate tail, 0: off */
+	unsigned int eng_out = out_channel_cnt; /* engine outputs, one per route with the route mixer */
+	int mix_index[MAX_CHANNEL_MAPS]; /* route -> engine output of the route mixer */
+	struct stat st;
+
+	float *p = NULL;  /* temp. IR file buffer */
+	size_t p_map_len = 0; /* p is memory-mapped */
+
+	int native = 0;
+	unsigned int k;
+	int rv;
+	int aborted = 0;
+
+	/* timing */
+	double t_start, t_lock, t_plan, t_end;
+	int have_wisdom = 0;
+
+	clv->fragment_size = buffersize;
+	clv->fifo_pos = 0;
+	clv->n_inp = in_channel_cnt;
+	clv->n_out = out_channel_cnt;
+	clv->draining = 0;
+	clv->fir_len = 0;
+	clv->silent_len = 0;
+	clv->n_programs = 0;
+
+	if (clv->engine) {
+		fprintf (stderr, "convoLV2: already initialized.\n");
+		return (-1);
+	}
+
+	if (in_channel_cnt < 1 || in_channel_cnt > MAX_CHANNELS || out_channel_cnt < 1 || out_channel_cnt > MAX_CHANNELS) {
+		fprintf (stderr, "convoLV2: invalid channel count (in: %u, out: %u, max: %d).\n",
+				in_channel_cnt, out_channel_cnt, MAX_CHANNELS);
+		return -1;
+	}
+
+	if (!clv->ir_fn) {
+		fprintf (stderr, "convoLV2: No IR file was configured.\n");
+		return -1;
+	}
+
+	if (access(clv->ir_fn, R_OK) != 0 || stat(clv->ir_fn, &st) != 0) {
+		fprintf(stderr, "convoLV2: cannot stat IR: %s\n", clv->ir_fn);
+		return -1;
+	}
+
+	/* decode, resample and deinterleave the IR.
+	 * This does not use FFTW and runs concurrently with other instances */
+	t_start = clv_time_ms ();
+
+	if ((aborted = init_aborted (clv))) {
+		goto errout;
+	}
+
+	if (ir_cache_probe (clv->ir_fn, st.st_mtime, sample_rate, &n_chan, &n_frames)) {
+		VERBOSE_printf("convoLV2: using cached IR data.\n");
+	} else if (audiofile_read (clv->ir_fn, sample_rate, clv->ir_disk_cache, &p, &p_map_len, &n_chan, &n_frames)) {
+		fprintf(stderr, "convoLV2: failed to read IR.\n");
+		goto errout;
+	}
+
+	if (n_frames == 0 || n_chan == 0) {
+		fprintf(stderr, "convoLV2: invalid IR file.\n");
+		goto errout;
+	}
+
+	if ((aborted = init_aborted (clv))) {
+		goto errout;
+	}
+
+	VERBOSE_printf("convoLV2: Proc: in: %d, out: %d || IR-file: %d chn, %d samples\n",
+			in_channel_cnt, out_channel_cnt, n_chan, n_frames);
+
+	// use the pre-configured routing matrix (from state), IFF it is valid for the current file
+	if (clv->custom_map) {
+		unsigned int n_routes = 0;
+		for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+			if (clv->chn_inp[c] == 0 || clv->chn_out[c] == 0 || clv->ir_chan[c] == 0) {
+				continue;
+			}
+			if (clv->chn_inp[c] > in_channel_cnt || clv->chn_out[c] > out_channel_cnt || clv->ir_chan[c] > n_chan) {
+				n_routes = 0;
+				break;
+			}
+			++n_routes;
+		}
+		if (n_routes == 0) {
+			VERBOSE_printf("convoLV2: custom routing matrix does not match, using channel map conventions.\n");
+			clv->custom_map = 0;
+		}
+	}
+
+	if (!clv->custom_map) {
+		channel_map_conventions (clv, in_channel_cnt, out_channel_cnt, n_chan);
+	}
+
+	// prepare IR data for every route
+	if (ir_prepare (clv, clv->ir_fn, st.st_mtime, sample_rate, &p, &p_map_len, n_chan, n_frames, &clv->prog[0])) {
+		goto errout;
+	}
+	audiofile_free (p, p_map_len); p = NULL;
+	clv->n_programs = 1;
+
+	// additional programs use the same routing matrix
+	if ((rv = bank_load (clv, sample_rate))) {
+		aborted = rv == -2;
+		goto errout;
+	}
+
+	/* effective length of every route: leading zeros are skipped, and the
+	 * tail is trimmed where the energy decay curve falls below the threshold.
+	 * The convolution length is the longest of all programs */
+	for (k = 0; k < clv->n_programs; ++k) {
+		IRProgram *prog = &clv->prog[k];
+		for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+			if (!prog->ir_data[c]) {
+				continue;
+			}
+			const unsigned int len = prog->ir_data[c]->n_frames;
+			ir_trim (prog->ir_data[c]->data, len, clv->ir_trim, &prog->ir_offset[c], &prog->ir_length[c]);
+			const unsigned int end = clv->ir_delay[c] + prog->ir_offset[c] + prog->ir_length[c];
+			if (end > max_size) {
+				max_size = end;
+			}
+			if (clv->ir_delay[c] + len > full_size) {
+				full_size = clv->ir_delay[c] + len;
+			}
+			if (prog->ir_length[c] < len) {
+				VERBOSE_printf("convoLV2: program %u, route %d: using IR samples %u..%u of %u\n",
+						k, c, prog->ir_offset[c], prog->ir_offset[c] + prog->ir_length[c], len);
+			}
+			n_part_full += (clv->ir_delay[c] + len + buffersize - 1) / buffersize;
+			n_part_used += prog->ir_length[c] > 0 ? (end - 1) / buffersize - (end - prog->ir_length[c]) / buffersize + 1 : 0;
+		}
+	}
+
+	if (max_size == 0) {
+		max_size = 1; // silent IR
+	}
 	if (max_size > clv->size) {
 		max_size = clv->size;
 	}
+	if (full_size > clv->size) {
+		full_size = clv->size;
+	}
+
+	if (max_size < full_size || n_part_used < n_part_full) {
+		VERBOSE_printf("convoLV2: effective convolution length %u of %u samples, period-sized partitions: %u of %u (%.0f%% less CPU)\n",
+				max_size, full_size, n_part_used, n_part_full, 100. * (n_part_full - n_part_used) / n_part_full);
+	}
+
+	clv->tail_len = eng_size = max_size;
+	clv->bank_fade_len = clv->bank_fade * sample_rate / 1000;
+
+	if (clv->mix && (clv->hybrid || clv->rr_factor > 1)) {
+		VERBOSE_printf("convoLV2: route mixer: hybrid and reduced-rate tail processing are not used.\n");
+	}
+	if (clv->rr_factor > 1 && !clv->mix) {
+		rr_lat = rr_plan (clv, buffersize, max_size);
+	}
+	if (rr_lat) {
+		/* the main engine only processes the head and the crossover */
+		eng_size = clv->rr_split + RR_TAPS * clv->rr_factor;
+	}
+
+	if (clv->n_programs > 1) {
+		/* all programs share the input spectra of the native engine */
+		VERBOSE_printf("convoLV2: IR bank with %u programs, using the native engine with uniform partitioning.\n", clv->n_programs);
+	} else if (clv->nonuniform && clv->max_part > buffersize) {
+		/* small head partitions, doubling up to max_part for the tail.
+		 * Partitions larger than the period are computed by zita-convolver's
+		 * background threads and synchronized in clv_convolve(). */
+		max_part = clv->max_part;
+	} else if (clv->standby && eng_size > Convproc::MAXPART) {
+		/* standby engines use the smallest period,
+		 * uniform partitioning would be prohibitively expensive for long IRs */
+		max_part = Convproc::MAXPART;
+	}
+
+	VERBOSE_printf("convoLV2: max-convolution length %d samples (limit %d), period: %d samples\n", max_size, clv->size, buffersize);
+	VERBOSE_printf("convoLV2: %s partitioning, partition size %d..%d\n",
+			max_part > buffersize ? "non-uniform" : "uniform", buffersize, max_part);
+
+	if (clv->hybrid && clv->n_programs == 1 && !rr_lat && !clv->mix && !(clv->buffered || clv->host_buffered)) {
+		/* FIR head length, this is also the FFT partition size */
+		unsigned int head = 0;
+		unsigned int n_routes = 0;
+		for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+			if (clv->prog[0].ir_data[c]) {
+				++n_routes;
+			}
+		}
+		if (clv->hybrid_head > 0) {
+			head = CALIB_MIN_PART;
+			while (head < CALIB_MAX_PART && (head << 1) <= clv->hybrid_head) {
+				head <<= 1;
+			}
+			if (head < 2 * buffersize || head >= max_size) {
+				VERBOSE_printf("convoLV2: hybrid head of %u taps is not usable (period: %u, length: %u).\n", head, buffersize, max_size);
+				head = 0;
+			}
+		} else {
+			head = calib_hybrid_split (clv->dsp, buffersize, max_size, in_channel_cnt, out_channel_cnt, n_routes);
+		}
+		if (head > 0) {
+			if (fir_setup (clv, head, max_size)) {
+				fprintf (stderr, "convoLV2: memory allocation failed for FIR head.\n");
+				goto errout;
+			}
+			quantum = head;
+			if (max_part < quantum) {
+				max_part = quantum;
+			}
+			VERBOSE_printf("convoLV2: hybrid: FIR head %u taps, FFT partitions %u..%u\n", head, quantum, max_part);
+		}
+	}
+
+	if (clv->n_programs > 1) {
+		native = 1;
+	} else if (clv->engine_type == CLV_ENGINE_NATIVE && max_part > quantum) {
+		VERBOSE_printf("convoLV2: native engine is uniform only, using zita-convolver for non-uniform partitioning.\n");
+	} else if (clv->engine_type == CLV_ENGINE_NATIVE) {
+		native = 1;
+	}
+	if (clv->compact && !native) {
+		VERBOSE_printf("convoLV2: compact IR spectra require the native engine.\n");
+	}
+
+	if (clv->mix && mix_setup (clv, sample_rate, mix_index)) {
+		fprintf (stderr, "convoLV2: memory allocation failed for the route mixer.\n");
+		goto errout;
+	}
+	if (clv->mix) {
+		eng_out = clv->mix_n_routes > 0 ? clv->mix_n_routes : 1;
+	}
+
+	/* set up the convolution engine */
+	if (clv->threaded) {
+#if ZITA_CONVOLVER_MAJOR_VERSION == 4
+		/* keep going if background partitions are late, count overloads */
+		options |= Convproc::OPT_LATE_CONTIN;
+#endif
+		policy = clv->thread_policy < 0 ? clv->rt_policy : clv->thread_policy;
+		if (policy == SCHED_FIFO || policy == SCHED_RR) {
+			/* zita-convolver lowers the priority of each level further */
+			abspri = clv->rt_prio + clv->thread_prio;
+		} else {
+			policy = SCHED_OTHER;
+		}
+	}
+
+#ifndef _WIN32
+	if (clv->fftw_wisdom) {
+		/* slow planning, but faster FFTs. Plans are remembered in the wisdom file */
+		options |= Convproc::OPT_FFTW_MEASURE;
+	}
+#endif
+
+	/* the planner lock may be held by other instances */
+	if ((aborted = init_aborted (clv))) {
+		goto errout;
+	}
+
+	t_lock = clv_time_ms ();
+
+	/* only FFTW plan creation (and destruction) is not thread-safe */
+	pthread_mutex_lock(&fftw_planner_lock);
+#ifndef _WIN32
+	if (clv->fftw_wisdom) {
+		have_wisdom = wisdom_load (quantum, max_part) == 0;
+	}
+#endif
+	t_plan = clv_time_ms ();
+
+	if (native) {
+		/* partitions that start at or after compact_split, engine offsets exclude the FIR head */
+		unsigned int compact = ~0u;
+		if (clv->compact) {
+			compact = (clv->compact_split > clv->fir_len ? clv->compact_split - clv->fir_len + quantum - 1 : 0) / quantum;
+		}
+		NativeEngine *ne = new NativeEngine (clv->dsp);
+		clv->engine = ne;
+		rv = ne->configure (in_channel_cnt, eng_out, eng_size - clv->fir_len, quantum, clv->n_programs, clv->fftw_wisdom, compact);
+	} else {
+		ZitaEngine *ze = new ZitaEngine (options);
+		clv->engine = ze;
+		rv = ze->configure (in_channel_cnt, eng_out, eng_size - clv->fir_len, quantum, max_part, clv->density);
+	}
+
+	if (!rv && rr_lat) {
+		/* FFTW wisdom is only kept for the main engine */
+		rv = rr_configure (clv, max_size, rr_lat, options & ~Convproc::OPT_FFTW_MEASURE);
+	}
+
+	if (rv) {
+		pthread_mutex_unlock(&fftw_planner_lock);
+		fprintf (stderr, "convoLV2: Cannot initialize convolution engine.\n");
+		goto errout;
+	}
+
+	t_end = clv_time_ms ();
+#ifndef _WIN32
+	if (clv->fftw_wisdom && (!have_wisdom || t_end - t_plan > 10)) {
+		/* new plans were measured */
+		wisdom_save (quantum, max_part);
+	}
+#endif
+	pthread_mutex_unlock(&fftw_planner_lock);
+
+	VERBOSE_printf("convoLV2: FFTW planning: %.1f ms%s\n", t_end - t_plan,
+			clv->fftw_wisdom ? (have_wisdom ? " (using wisdom)" : " (wisdom saved)") : "");
+
+	// assign channel map to convolution engine, one set of routes per program
+	for (k = 0; k < clv->n_programs; ++k) {
+		const IRProgram *prog = &clv->prog[k];
+		if (clv->engine->load_program (k)) {
+			fprintf (stderr, "convoLV2: Cannot load IR program %u.\n", k);
+			goto errout;
+		}
+		for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+			if (!prog->ir_data[c]) {
+				continue;
+			}
+
+			const unsigned int delay = clv->ir_delay[c];
+			unsigned int ind0 = delay + prog->ir_offset[c];
+			unsigned int ind1 = ind0 + prog->ir_length[c];
+			if (clv->fir_len) {
+				/* the head is processed by the FIR, the engine runs one partition late */
+				ind0 = ind0 > clv->fir_len ? ind0 : clv->fir_len;
+				ind1 = ind1 < max_size ? ind1 : max_size;
+			}
+			ind1 = ind1 < eng_size ? ind1 : eng_size;
+
+			if (k == 0) {
+				VERBOSE_printf ("convoLV2: SET in %d -> out %d [IR chn:%d gain:%+.3f dly:%d]\n",
+						clv->chn_inp[c],
+						clv->chn_out[c],
+						clv->ir_chan[c],
+						clv->ir_gain[c],
+						clv->ir_delay[c]
+						);
+			}
+
+			if (ind1 <= ind0 || (clv->mix && mix_index[c] < 0)) {
+				continue;
+			}
+			if ((aborted = init_aborted (clv))) {
+				goto errout;
+			}
+
+			const float *data = prog->ir_data[c]->data + (ind0 - delay);
+			float *head = NULL;
+			if (rr_lat && ind1 > clv->rr_split) {
+				/* fade out the head over the crossover, the tail engine fades in */
+				const unsigned int xover = RR_TAPS * clv->rr_factor;
+				if (!(head = (float*) malloc ((ind1 - ind0) * sizeof (float)))) {
+					fprintf (stderr, "convoLV2: memory allocation failed for IR head.\n");
+					goto errout;
+				}
+				for (unsigned int i = ind0; i < ind1; ++i) {
+					const double w = i < clv->rr_split ? 1. : .5 + .5 * cos (M_PI * (i - clv->rr_split) / xover);
+					head[i - ind0] = data[i - ind0] * w;
+				}
+				data = head;
+			}
+
+			rv = clv->engine->impdata_create (
+					clv->chn_inp[c] - 1,
+					clv->mix ? mix_index[c] : clv->chn_out[c] - 1,
+					data, ind0 - clv->fir_len, ind1 - clv->fir_len);
+			free (head);
+			if (rv) {
+				fprintf (stderr, "convoLV2: Cannot set IR data.\n");
+				goto errout;
+			}
+		}
+	}
+
+	if (rr_lat && rr_load (clv, max_size, rr_lat)) {
+		fprintf (stderr, "convoLV2: Cannot set IR data of the tail.\n");
+		goto errout;
+	}
+
+	if (clv->program >= clv->n_programs) {
+		clv->program = 0;
+	}
+	clv->engine->select_program (clv->program, 0);
+
+	if (max_part > quantum) {
+		VERBOSE_printf("convoLV2: %s background processing, policy: %d, priority: %d\n",
+				clv->threaded ? "async" : "sync", policy, abspri);
+	}
+
+	/* the engine's output is silent once the input was silent for the IR length,
+	 * plus partitions that are still being computed */
+	clv->settle_len = clv->tail_len + 2 * max_part + buffersize;
+	if (clv->rr_engine) {
+		/* the tail engine's period and the spread of the interpolation filter */
+		clv->settle_len += clv->rr_factor * (clv->rr_part + RR_TAPS);
+	}
+	if (clv->mix) {
+		clv->settle_len += clv->mix_delay_max;
+	}
+	/* the largest partition is processed at least once */
+	clv->warmup_len = 2 * max_part + buffersize;
+	if (clv->rr_engine) {
+		clv->warmup_len += clv->rr_factor * clv->rr_part;
+	}
+
+	if (!(clv->buffered || clv->host_buffered)) {
+		/* clv_rebuffer() can switch to buffered processing at runtime */
+		for (c = 0; c < in_channel_cnt; ++c) {
+			if (!(clv->rb_inp[c] = (float*) calloc (buffersize, sizeof (float)))) {
+				goto errout;
+			}
+		}
+		for (c = 0; c < out_channel_cnt; ++c) {
+			if (!(clv->rb_out[c] = (float*) calloc (buffersize, sizeof (float)))) {
+				goto errout;
+			}
+		}
+	}
+
+	if ((aborted = init_aborted (clv))) {
+		goto errout;
+	}
+
+	if (clv->engine->start (abspri, policy)
+			|| (clv->rr_engine && clv->rr_engine->start (abspri, policy))) {
+		fprintf(stderr, "convoLV2: Cannot start processing.\n");
+		goto errout;
+	}
+
+	/* after start(): the native engine converts compact partitions */
+#if 1 // INFO
+	clv->engine->print (stderr);
+	if (clv->rr_engine) {
+		clv->rr_engine->print (stderr);
+	}
+#endif
 
-	VERBOSE_printf("convoLV2: max-convolution length %d samples (limit %d), period: %d samples\n", max_size, clv->size, buffersize);
+	VERBOSE_printf("convoLV2: IR load: %.1f ms, planner lock wait: %.1f ms, held: %.1f ms, total: %.1f ms\n",
+			t_lock - t_start, t_plan - t_lock, t_end - t_plan, clv_time_ms () - t_start);
+	return 0;
 
+errout:
+	audiofile_free (p, p_map_len);
+	if (clv->engine) {
+		pthread_mutex_lock(&fftw_planner_lock);
+		delete(clv->engine);
+		pthread_mutex_unlock(&fftw_planner_lock);
+	}
+	clv->engine = NULL;
+	fir_free (clv);
+	rb_free (clv);
+	rr_free (clv);
+	mix_free (clv);
+	prog_release (clv);
+	return aborted ? -2 : -1;
+}
 
-	if (clv->convproc->configure (
-				/*in*/  in_channel_cnt,
-				/*out*/ out_channel_cnt,
-				/*max-convolution length */ max_size,
-				/*quantum*/  buffersize,
-				/*min-part*/ buffersize /* must be >= fragm */,
-				/*max-part*/ buffersize /* Convproc::MAXPART -> stich output every period */
-#if ZITA_CONVOLVER_MAJOR_VERSION == 4
-				, clv->density
-#endif
-				)) {
-		fprintf (stderr, "convoLV2: Cannot initialize convolution engine.\n");
-		goto errout;
+int clv_is_active (LV2convolv *clv) {
+	if (!clv || !clv->engine || !clv->ir_fn) {
+		return 0;
 	}
+	return 1;
+}
 
-	gb = (float*) malloc (n_frames * sizeof(float));
-	if (!gb) {
-		fprintf (stderr, "convoLV2: memory allocation failed for convolution buffer.\n");
-		goto errout;
+static void silent_output(float * const * outbuf, size_t n_channels, size_t n_samples) {
+	unsigned int c;
+	for (c = 0; c < n_channels; ++c) {
+		memset (outbuf[c], 0, n_samples * sizeof(float));
 	}
+}
 
-	VERBOSE_printf("convoLV2: Proc: in: %d, out: %d || IR-file: %d chn, %d samples\n",
-			in_channel_cnt, out_channel_cnt, n_chan, n_frames);
+/** silence outputs from offset to the end of the block */
+static void silent_output_from(float * const * outbuf, size_t n_channels, size_t offset, size_t n_samples) {
+	unsigned int c;
+	for (c = 0; c < n_channels; ++c) {
+		memset (outbuf[c] + offset, 0, (n_samples - offset) * sizeof(float));
+	}
+}
 
-	// TODO use pre-configured channel-map (from state), IFF set and valid for the current file
+/** set up denormal protection for the current process cycle
+ * @return input offset to use with copy_input()
+ */
+static float denormal_enter (LV2convolv *clv, unsigned int *csr) {
+#ifdef CLV_X86_DISPATCH
+	if (clv->ftz) {
+		*csr = mxcsr_enter ();
+		return 0.f;
+	}
+#endif
+	return 1e-20f;
+}
 
-	// reset channel map
-	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
-		clv->ir_chan[c] = 0;
-		clv->chn_inp[c] = 0;
-		clv->chn_out[c] = 0;
+static void denormal_leave (LV2convolv *clv, unsigned int csr) {
+#ifdef CLV_X86_DISPATCH
+	if (clv->ftz) {
+		mxcsr_leave (csr);
 	}
+#endif
+}
 
-	// follow channel map conventions
-	if (n_elem == n_chan) {
-		// exact match: for every input-channel, iterate over all outputs
-		// eg.  1: L -> L , 2: L -> R, 3: R -> L, 4: R -> R
-		for (c = 0; c < n_chan && c < MAX_CHANNEL_MAPS; ++c) {
-			clv->ir_chan[c] = 1 + c;
-			clv->chn_inp[c] = 1 + ((c / out_channel_cnt) % in_channel_cnt);
-			clv->chn_out[c] = 1 +  (c % out_channel_cnt);
+/** count late/overload flags of a process cycle
+ * @return 0 on success, -1 if the engine stopped
+ */
+static int process_status (LV2convolv *clv, const int f) {
+	if (f) {
+		/* Note this will actually never happen in sync-mode */
+		if (f & ConvEngine::FL_LATE) {
+			++clv->n_late;
 		}
-	}
-	else if (n_elem > n_chan) {
-		VERBOSE_printf("convoLV2: IR file has too few channels for given processor config.\n");
-		// missing some channels, first assign  in -> out, then x-over
-		// eg.  1: L -> L , 2: R -> R,  3: L -> R,  4: R -> L
-		// this allows to e.g load a 2-channel (stereo) IR into a
-		// 2x2 true-stereo effect instance
-		for (c = 0; c < n_chan && c < MAX_CHANNEL_MAPS; ++c) {
-			clv->ir_chan[c] = 1 + c;
-			clv->chn_inp[c] = 1 + (c % in_channel_cnt);
-			clv->chn_out[c] = 1 + (((c + c / in_channel_cnt) % in_channel_cnt) % out_channel_cnt);
+		if (f & ConvEngine::FL_LOAD) {
+			++clv->n_load;
 		}
-		// assign mono input to 1: L -> L , 2: R -> R,
-		for (;n_chan == 1 && c < 2; ++c) {
-			clv->ir_chan[c] = 1;
-			clv->chn_inp[c] = 1 + (c % in_channel_cnt);
-			clv->chn_out[c] = 1 + (c % out_channel_cnt);
+		if (!clv->engine->running ()) {
+			return -1;
 		}
 	}
-	else {
-		assert (n_elem < n_chan);
-		VERBOSE_printf("convoLV2: IR file has too many channels for given processor config.\n");
-		// allow loading a quad file to a mono-in stereo-out
-		// eg.  1: L -> L , 2: L -> R
-		for (c = 0; c < n_elem && c < MAX_CHANNEL_MAPS; ++c) {
-			clv->ir_chan[c] = 1 + c;
-			clv->chn_inp[c] = 1 + ((c / out_channel_cnt) % in_channel_cnt);
-			clv->chn_out[c] = 1 +  (c % out_channel_cnt);
+	return 0;
+}
+
+#define CLV_SILENCE 1e-9f // -180 dBFS
+
+/** input silence detection
+ * @return 1 if processing of this fragment can be skipped
+ */
+static int bypass_fragment (LV2convolv *clv,
+		const float * const * inbuf,
+		const unsigned int off,
+		const unsigned int in_channel_cnt,
+		const unsigned int n_samples)
+{
+	unsigned int c;
+	if (!clv->bypass) {
+		return 0;
+	}
+	for (c = 0; c < in_channel_cnt && c < clv->n_inp; ++c) {
+		if (clv->dsp->peak (inbuf[c] + off, n_samples) > CLV_SILENCE) {
+			clv->silent_len = 0;
+			return 0;
 		}
 	}
+	if (clv->silent_len < clv->settle_len) {
+		/* the tail is still decaying */
+		clv->silent_len += n_samples;
+		return 0;
+	}
+	/* The engine's state is equivalent to silence, not processing is the same
+	 * as pausing time. Processing resumes at the same position in the partition */
+	++clv->n_bypass;
+	return 1;
+}
 
-	// assign channel map to convolution engine
-	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
-		unsigned int i;
-		if (clv->chn_inp[c] == 0 || clv->chn_out[c] == 0 || clv->ir_chan[c] == 0) {
-			continue;
-		}
+/** process one fragment of the engine's input buffers
+ * @return 0 on success, -1 if the engine stopped
+ */
+static int process_fragment (LV2convolv *clv) {
+	/* sync: wait for non-uniform partitions computed in the background
+	 * async: use whatever partitions are ready, flag late ones */
+	const double t0 = clv_time_ms ();
+	const int f = clv->engine->process (!clv->threaded);
+	if (clv->mix) {
+		mix_fragment (clv);
+	}
+	clv->proc_time += clv_time_ms () - t0;
+	return process_status (clv, f);
+}
 
-		assert (clv->ir_chan[c] <= n_chan);
+/** process one fragment of the host's buffers at the given offset
+ * @return 0 on success, -1 if the engine stopped
+ */
+static int process_block (LV2convolv *clv,
+		const float * const * inbuf,
+		float * const * outbuf,
+		const unsigned int off,
+		const unsigned int in_channel_cnt,
+		const unsigned int out_channel_cnt,
+		const float offset,
+		const float gain,
+		const float gain_step)
+{
+	const double t0 = clv_time_ms ();
+	const int f = clv->engine->process_block (clv->dsp, inbuf, outbuf, off,
+			in_channel_cnt, out_channel_cnt, clv->fragment_size,
+			offset, gain, gain_step, !clv->threaded);
+	clv->proc_time += clv_time_ms () - t0;
+	return process_status (clv, f);
+}
 
-		for (i = 0; i < n_frames; ++i) {
-			// decode interleaved channels, apply gain scaling
-			gb[i] = p[i * n_chan + clv->ir_chan[c] - 1] * clv->ir_gain[c];
+/** hybrid processing of one fragment, the result is written to fir_out[]
+ * @param inbuf input, NULL to process silence
+ * @return 0 on success, -1 if the engine stopped
+ */
+static int hybrid_fragment (LV2convolv *clv,
+		const float * const * inbuf,
+		const unsigned int off,
+		const unsigned int in_channel_cnt,
+		const float offset)
+{
+	unsigned int c;
+	const unsigned int n = clv->fragment_size;
+	const unsigned int h = clv->fir_len - 1;
+	const double t0 = clv_time_ms ();
+
+	for (c = 0; c < clv->n_inp; ++c) {
+		float *x = clv->fir_hist[c];
+		memmove (x, x + n, h * sizeof (float));
+		if (inbuf && c < in_channel_cnt) {
+			clv->dsp->copy_input (x + h, inbuf[c] + off, n, offset);
+		} else {
+			memset (x + h, 0, n * sizeof (float));
 		}
+		memcpy (clv->engine->inpdata (c) + clv->fifo_pos, x + h, n * sizeof (float));
+	}
 
-		VERBOSE_printf ("convoLV2: SET in %d -> out %d [IR chn:%d gain:%+.3f dly:%d]\n",
-				clv->chn_inp[c],
-				clv->chn_out[c],
-				clv->ir_chan[c],
-				clv->ir_gain[c],
-				clv->ir_delay[c]
-			       );
+	/* FFT part: output of the previous partition */
+	for (c = 0; c < clv->n_out; ++c) {
+		memcpy (clv->fir_out[c], clv->engine->outdata (c) + clv->fifo_pos, n * sizeof (float));
+	}
 
-		clv->convproc->impdata_create (
-				clv->chn_inp[c] - 1,
-				clv->chn_out[c] - 1,
-				1, gb, clv->ir_delay[c], clv->ir_delay[c] + n_frames);
+	for (c = 0; c < MAX_CHANNEL_MAPS; ++c) {
+		if (!clv->fir_coef[c]) {
+			continue;
+		}
+		const unsigned int k0 = clv->fir_k0[c];
+		clv->dsp->fir (clv->fir_out[clv->chn_out[c] - 1],
+				clv->fir_hist[clv->chn_inp[c] - 1] + h - k0,
+				clv->fir_coef[c] + k0, clv->fir_k1[c] - k0, n);
 	}
+	clv->proc_time += clv_time_ms () - t0;
 
-	free(gb); gb = NULL;
-	free(p);  p  = NULL;
+	clv->fifo_pos += n;
+	if (clv->fifo_pos == clv->fir_len) {
+		clv->fifo_pos = 0;
+		return process_fragment (clv);
+	}
+	return 0;
+}
 
-#if 1 // INFO
-	clv->convproc->print (stderr);
-#endif
+/** reduced-rate tail of one fragment: decimate the input into the tail engine,
+ * and interpolate its output to rr_out[]. The tail engine is buffered.
+ * @param inbuf input, NULL to process silence
+ * @return 0 on success, -1 if the engine stopped
+ */
+static int rr_fragment (LV2convolv *clv,
+		const float * const * inbuf,
+		const unsigned int off,
+		const unsigned int in_channel_cnt,
+		const float offset)
+{
+	unsigned int c, p, m;
+	const unsigned int D = clv->rr_factor;
+	const unsigned int n = clv->fragment_size / D;
+	const unsigned int h = RR_TAPS - 1;
+	const unsigned int stride = h + n;
+	const double t0 = clv_time_ms ();
+	int rv = 0;
 
-	if (clv->convproc->start_process (0, 0)) {
-		fprintf(stderr, "convoLV2: Cannot start processing.\n");
-		goto errout;
+	/* polyphase decimation: branch p holds every D-th input sample, starting at D - 1 - p */
+	for (c = 0; c < clv->n_inp; ++c) {
+		float *y = clv->rr_engine->inpdata (c) + clv->rr_pos;
+		memset (y, 0, n * sizeof (float));
+		for (p = 0; p < D; ++p) {
+			float *x = clv->rr_dec[c] + p * stride;
+			memmove (x, x + n, h * sizeof (float));
+			if (inbuf && c < in_channel_cnt) {
+				const float *src = inbuf[c] + off + D - 1 - p;
+				for (m = 0; m < n; ++m) {
+					x[h + m] = src[m * D] + offset;
+				}
+			} else {
+				memset (x + h, 0, n * sizeof (float));
+			}
+			clv->dsp->fir (y, x + h, clv->rr_coef + p * RR_TAPS, RR_TAPS, n);
+		}
 	}
 
-	pthread_mutex_unlock(&fftw_planner_lock);
-	return 0;
+	/* polyphase interpolation of the output of the previous period */
+	for (c = 0; c < clv->n_out; ++c) {
+		float *x = clv->rr_int[c];
+		memmove (x, x + n, h * sizeof (float));
+		memcpy (x + h, clv->rr_engine->outdata (c) + clv->rr_pos, n * sizeof (float));
+		for (p = 0; p < D; ++p) {
+			memset (clv->rr_tmp, 0, n * sizeof (float));
+			clv->dsp->fir (clv->rr_tmp, x + h, clv->rr_coef + p * RR_TAPS, RR_TAPS, n);
+			for (m = 0; m < n; ++m) {
+				clv->rr_out[c][m * D + p] = D * clv->rr_tmp[m];
+			}
+		}
+	}
 
-errout:
-	free(gb);
-	free(p);
-	delete(clv->convproc);
-	clv->convproc = NULL;
-	pthread_mutex_unlock(&fftw_planner_lock);
-	return -1;
+	clv->rr_pos += n;
+	if (clv->rr_pos == clv->rr_part) {
+		clv->rr_pos = 0;
+		const int f = clv->rr_engine->process (!clv->threaded);
+		if (f & ConvEngine::FL_LATE) {
+			++clv->n_late;
+		}
+		if (f & ConvEngine::FL_LOAD) {
+			++clv->n_load;
+		}
+		if (f && !clv->rr_engine->running ()) {
+			rv = -1;
+		}
+	}
+	clv->proc_time += clv_time_ms () - t0;
+	return rv;
 }
 
-int clv_is_active (LV2convolv *clv) {
-	if (!clv || !clv->convproc || !clv->ir_fn) {
-		return 0;
-	}
-	return 1;
+int clv_convolve (LV2convolv *clv,
+		const float * const * inbuf,
+		float * const * outbuf,
+		const unsigned int in_channel_cnt,
+		const unsigned int out_channel_cnt,
+		const unsigned int n_samples,
+		const float output_gain)
+{
+	return clv_convolve_ramp (clv, inbuf, outbuf, in_channel_cnt, out_channel_cnt, n_samples, output_gain, output_gain);
 }
 
-static void silent_output(float * const * outbuf, size_t n_channels, size_t n_samples) {
+/** zero-latency processing of a block that is a multiple of the fragment size */
+static void process_direct (LV2convolv *clv,
+		const float * const * inbuf,
+		float * const * outbuf,
+		const unsigned int in_channel_cnt,
+		const unsigned int out_channel_cnt,
+		const unsigned int n_samples,
+		const float offset,
+		const float gain_start,
+		const float gain_step)
+{
+	const DSPKernels *dsp = clv->dsp;
 	unsigned int c;
-	for (c = 0; c < n_channels; ++c) {
-		memset (outbuf[c], 0, n_samples * sizeof(float));
+	unsigned int off;
+
+	if (clv->fir_len) {
+		/* hybrid, zero latency */
+		for (off = 0; off < n_samples; off += clv->fragment_size) {
+			if (bypass_fragment (clv, inbuf, off, in_channel_cnt, clv->fragment_size)) {
+				silent_output_from(outbuf, out_channel_cnt, off, off + clv->fragment_size);
+				continue;
+			}
+			if (hybrid_fragment (clv, inbuf, off, in_channel_cnt, offset)) {
+				silent_output_from(outbuf, out_channel_cnt, off, n_samples);
+				break;
+			}
+			for (c = 0; c < out_channel_cnt && c < clv->n_out; ++c) {
+				dsp->copy_output (outbuf[c] + off, clv->fir_out[c], clv->fragment_size, gain_start + off * gain_step, gain_step);
+			}
+		}
+		return;
+	}
+
+	if (clv->mix) {
+		/* route mixer, zero latency */
+		for (off = 0; off < n_samples; off += clv->fragment_size) {
+			if (bypass_fragment (clv, inbuf, off, in_channel_cnt, clv->fragment_size)) {
+				silent_output_from(outbuf, out_channel_cnt, off, off + clv->fragment_size);
+				continue;
+			}
+			for (c = 0; c < in_channel_cnt && c < clv->n_inp; ++c) {
+				dsp->copy_input (clv->engine->inpdata (c), inbuf[c] + off, clv->fragment_size, offset);
+			}
+			if (process_fragment (clv)) {
+				silent_output_from(outbuf, out_channel_cnt, off, n_samples);
+				break;
+			}
+			for (c = 0; c < out_channel_cnt && c < clv->n_out; ++c) {
+				dsp->copy_output (outbuf[c] + off, clv->mix_out[c], clv->fragment_size, gain_start + off * gain_step, gain_step);
+			}
+		}
+		return;
+	}
+
+	/* zero latency: process block in fragments */
+	for (off = 0; off < n_samples; off += clv->fragment_size) {
+		if (bypass_fragment (clv, inbuf, off, in_channel_cnt, clv->fragment_size)) {
+			silent_output_from(outbuf, out_channel_cnt, off, off + clv->fragment_size);
+			continue;
+		}
+		/* the tail reads the input first, output may alias input */
+		if (clv->rr_engine && rr_fragment (clv, inbuf, off, in_channel_cnt, offset)) {
+			silent_output_from(outbuf, out_channel_cnt, off, n_samples);
+			break;
+		}
+		if (process_block (clv, inbuf, outbuf, off, in_channel_cnt, out_channel_cnt,
+					offset, gain_start + off * gain_step, gain_step)) {
+			silent_output_from(outbuf, out_channel_cnt, off, n_samples);
+			break;
+		}
+		for (c = 0; clv->rr_engine && c < out_channel_cnt && c < clv->n_out; ++c) {
+			dsp->mix_output (outbuf[c] + off, clv->rr_out[c], clv->fragment_size, gain_start + off * gain_step, gain_step);
+		}
 	}
 }
 
-int clv_convolve (LV2convolv *clv,
+static int convolve_ramp (LV2convolv *clv,
 		const float * const * inbuf,
 		float * const * outbuf,
 		const unsigned int in_channel_cnt,
 		const unsigned int out_channel_cnt,
 		const unsigned int n_samples,
-		const float output_gain)
+		const float gain_start,
+		const float gain_end)
 {
 	unsigned int c;
+	unsigned int off;
+	unsigned int csr = 0;
 
-	if (!clv || !clv->convproc) {
+	if (!clv || !clv->engine) {
 		silent_output(outbuf, out_channel_cnt, n_samples);
 		return (0);
 	}
 
-	if (clv->convproc->state () == Convproc::ST_WAIT) {
-		clv->convproc->check_stop ();
+	clv->proc_time = 0;
+
+	if (!clv->engine->running ()) {
+		/* This cannot happen in sync-mode, but zita-convolver 3
+		 * stops processing after repeated overloads in async mode */
+		silent_output(outbuf, out_channel_cnt, n_samples);
+		return (n_samples);
 	}
 
-	if (clv->fragment_size != n_samples) {
+	if (!(clv->buffered || clv->host_buffered || clv->rebuffered) && n_samples % clv->fragment_size) {
 		silent_output(outbuf, out_channel_cnt, n_samples);
 		return -1;
 	}
 
-#if 1
-	if (clv->convproc->state () != Convproc::ST_PROC) {
-		/* This cannot happen in sync-mode, but... */
-		assert (0);
-		silent_output(outbuf, out_channel_cnt, n_samples);
+	const DSPKernels *dsp = clv->dsp;
+	const float gain_step = (gain_end - gain_start) / n_samples;
+	const float offset = denormal_enter (clv, &csr);
+
+	if (clv->buffered || clv->host_buffered) {
+		/* Arbitrary block-length: collect input in the engine's input buffer,
+		 * and read the output of the previous fragment, which the engine keeps
+		 * until the next process() call. Latency: one fragment */
+		for (off = 0; off < n_samples;) {
+			const unsigned int pos = clv->fifo_pos;
+			unsigned int n = clv->fragment_size - pos;
+			if (n > n_samples - off) {
+				n = n_samples - off;
+			}
+			if (bypass_fragment (clv, inbuf, off, in_channel_cnt, n)) {
+				silent_output_from(outbuf, out_channel_cnt, off, off + n);
+				off += n;
+				continue;
+			}
+			for (c = 0; c < in_channel_cnt; ++c) {
+				dsp->copy_input (clv->engine->inpdata (c) + pos, inbuf[c] + off, n, offset);
+			}
+			for (c = 0; c < out_channel_cnt; ++c) {
+				const float *src = clv->mix ? clv->mix_out[c] : clv->engine->outdata (c);
+				dsp->copy_output (outbuf[c] + off, src + pos, n, gain_start + off * gain_step, gain_step);
+			}
+			off += n;
+			clv->fifo_pos += n;
+			if (clv->fifo_pos == clv->fragment_size) {
+				clv->fifo_pos = 0;
+				if (process_fragment (clv)) {
+					silent_output_from(outbuf, out_channel_cnt, off, n_samples);
+					break;
+				}
+			}
+		}
+		denormal_leave (clv, csr);
 		return (n_samples);
 	}
-#endif
 
-	for (c = 0; c < in_channel_cnt; ++c)
-#if 0 // no denormal protection
-		memcpy (clv->convproc->inpdata (c), inbuf[c], n_samples * sizeof (float));
-#else // prevent denormals
-	{
-		unsigned int i;
-		float *id = clv->convproc->inpdata(c);
-		for (i = 0; i < n_samples; ++i) {
-			id[i] = inbuf[c][i] + 1e-20f;
+	if (clv->rebuffered) {
+		/* a zero-latency engine with arbitrary block-lengths: collect one
+		 * fragment and process it as a block, the output is one fragment late */
+		for (off = 0; off < n_samples;) {
+			const unsigned int pos = clv->rb_pos;
+			unsigned int n = clv->fragment_size - pos;
+			if (n > n_samples - off) {
+				n = n_samples - off;
+			}
+			for (c = 0; c < in_channel_cnt && c < clv->n_inp; ++c) {
+				memcpy (clv->rb_inp[c] + pos, inbuf[c] + off, n * sizeof (float));
+			}
+			for (c = 0; c < out_channel_cnt && c < clv->n_out; ++c) {
+				dsp->copy_output (outbuf[c] + off, clv->rb_out[c] + pos, n, gain_start + off * gain_step, gain_step);
+			}
+			off += n;
+			clv->rb_pos += n;
+			if (clv->rb_pos == clv->fragment_size) {
+				clv->rb_pos = 0;
+				process_direct (clv, clv->rb_inp, clv->rb_out, clv->n_inp, clv->n_out, clv->fragment_size, offset, 1.f, 0.f);
+			}
 		}
+		denormal_leave (clv, csr);
+		return (n_samples);
 	}
-#endif
 
-	int f = clv->convproc->process (false);
+	process_direct (clv, inbuf, outbuf, in_channel_cnt, out_channel_cnt, n_samples, offset, gain_start, gain_step);
+	denormal_leave (clv, csr);
+	return (n_samples);
+}
 
-	if (f /*&Convproc::FL_LOAD)*/ ) {
-		/* Note this will actually never happen in sync-mode */
-		assert (0);
-		silent_output(outbuf, out_channel_cnt, n_samples);
-		return (n_samples);
+int clv_convolve_ramp (LV2convolv *clv,
+		const float * const * inbuf,
+		float * const * outbuf,
+		const unsigned int in_channel_cnt,
+		const unsigned int out_channel_cnt,
+		const unsigned int n_samples,
+		const float gain_start,
+		const float gain_end)
+{
+	const int rv = convolve_ramp (clv, inbuf, outbuf, in_channel_cnt, out_channel_cnt, n_samples, gain_start, gain_end);
+	if (clv && clv->proc_time > 0) {
+		/* the first period after going online shows page-faults and cold caches */
+		if (clv->n_periods++ == 0) {
+			clv->first_time = clv->proc_time;
+		}
+		clv->sum_time += clv->proc_time;
 	}
+	return rv;
+}
+
+int clv_warmup (LV2convolv *clv) {
+	float *inp[MAX_CHANNELS];
+	float *out[MAX_CHANNELS];
+	unsigned int c, k;
+	int rv = 0;
+
+	if (!clv || !clv->engine) {
+		return -1;
+	}
+
+	clv_buffers (clv, buf_prefault, NULL);
 
-	for (c = 0; c < out_channel_cnt; ++c) {
-		if (output_gain == 1.0) {
-			memcpy (outbuf[c], clv->convproc->outdata (c), n_samples * sizeof (float));
+	if (clv->mlock && !clv->locked) {
+		MemLock ml = { 0, 0, 0 };
+		clv_buffers (clv, buf_lock, &ml);
+		clv->locked = ml.locked;
+		if (ml.failed) {
+			VERBOSE_printf("convoLV2: cannot lock %.1f MiB of engine memory: %s\n", ml.failed / 1048576., strerror (ml.err));
 		} else {
-			unsigned int s;
-			float const * const od = clv->convproc->outdata (c);
-			for (s = 0; s < n_samples; ++s) {
-				outbuf[c][s] = od[s] * output_gain;
+			VERBOSE_printf("convoLV2: locked %.1f MiB of engine memory\n", ml.locked / 1048576.);
+		}
+	}
+
+	/* process silence: this also faults in zita-convolver's buffers,
+	 * and leaves the engine in the same state as before */
+	const unsigned int n = clv->fragment_size;
+	memset (inp, 0, sizeof (inp));
+	memset (out, 0, sizeof (out));
+	for (c = 0; c < clv->n_inp; ++c) {
+		if (!(inp[c] = (float*) calloc (n, sizeof (float)))) {
+			rv = -1;
+		}
+	}
+	for (c = 0; c < clv->n_out; ++c) {
+		if (!(out[c] = (float*) calloc (n, sizeof (float)))) {
+			rv = -1;
+		}
+	}
+	if (rv == 0) {
+		/* wait for the background partitions: in async mode they would be
+		 * flagged late, and zita-convolver may stop after repeated overloads */
+		const int threaded = clv->threaded;
+		const double t0 = clv_time_ms ();
+		const unsigned int n_cycles = 1 + clv->warmup_len / n;
+		clv->threaded = 0;
+		for (k = 0; k < n_cycles && rv == 0; ++k) {
+			if (init_aborted (clv)) {
+				rv = -2;
+			} else if (clv_convolve (clv, inp, out, clv->n_inp, clv->n_out, n, 1.f) != (int) n) {
+				rv = -1;
 			}
 		}
+		clv->threaded = threaded;
+		VERBOSE_printf("convoLV2: warm-up: %u periods, %.1f ms\n", k, clv_time_ms () - t0);
+	}
+	if (rv == 0 && !(clv_is_active (clv) && clv->engine->running ())) {
+		fprintf (stderr, "convoLV2: engine stopped during warm-up.\n");
+		rv = -1;
+	}
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (inp[c]);
+		free (out[c]);
 	}
 
-	return (n_samples);
+	/* statistics start when the engine goes online */
+	clv->proc_time = 0;
+	clv->silent_len = 0;
+	clv->n_late = clv->n_load = clv->n_bypass = 0;
+	clv->n_periods = 0;
+	clv->first_time = clv->sum_time = 0;
+	return rv;
+}
+
+int clv_drain (LV2convolv *clv,
+		float * const * outbuf,
+		const unsigned int out_channel_cnt,
+		const unsigned int n_samples,
+		const float gain_start,
+		const float gain_end)
+{
+	unsigned int c;
+	unsigned int off;
+	unsigned int csr = 0;
+
+	if (!clv || !clv->engine || clv->buffered || clv->host_buffered || clv->rebuffered) {
+		return 0;
+	}
+
+	clv->proc_time = 0;
+	const float gain_step = (gain_end - gain_start) / n_samples;
+
+	if (!clv->draining) {
+		/* all input up to now has been processed, the remaining output
+		 * is the engine's response to silence */
+		clv->draining = 1;
+		clv->drain_pos = clv->fragment_size;
+		clv->drain_left = clv->tail_len + clv->fragment_size;
+		if (clv->rr_engine) {
+			/* spread of the interpolation filter */
+			clv->drain_left += clv->rr_factor * RR_TAPS;
+		}
+		if (clv->mix) {
+			clv->drain_left += clv->mix_delay_max;
+		}
+		if (clv->bypass && clv->silent_len >= clv->settle_len) {
+			/* already silent */
+			clv->drain_left = 0;
+		}
+	}
+
+	if (!clv->engine->running ()) {
+		clv->drain_left = 0;
+	}
+
+	denormal_enter (clv, &csr);
+	for (off = 0; off < n_samples && clv->drain_left > 0;) {
+		if (clv->drain_pos == clv->fragment_size) {
+			int rv;
+			if (clv->fir_len) {
+				rv = hybrid_fragment (clv, NULL, 0, 0, 0.f);
+			} else {
+				for (c = 0; c < clv->n_inp; ++c) {
+					memset (clv->engine->inpdata (c), 0, clv->fragment_size * sizeof (float));
+				}
+				rv = process_fragment (clv);
+			}
+			if (!rv && clv->rr_engine) {
+				rv = rr_fragment (clv, NULL, 0, 0, 0.f);
+			}
+			if (rv) {
+				clv->drain_left = 0;
+				break;
+			}
+			clv->drain_pos = 0;
+		}
+
+		unsigned int n = clv->fragment_size - clv->drain_pos;
+		if (n > n_samples - off) {
+			n = n_samples - off;
+		}
+		for (c = 0; c < out_channel_cnt && c < clv->n_out; ++c) {
+			const float *src = clv->fir_len ? clv->fir_out[c] : clv->mix ? clv->mix_out[c] : clv->engine->outdata (c);
+			clv->dsp->mix_output (outbuf[c] + off, src + clv->drain_pos, n, gain_start + off * gain_step, gain_step);
+			if (clv->rr_engine) {
+				clv->dsp->mix_output (outbuf[c] + off, clv->rr_out[c] + clv->drain_pos, n, gain_start + off * gain_step, gain_step);
+			}
+		}
+		off += n;
+		clv->drain_pos += n;
+		clv->drain_left = clv->drain_left > n ? clv->drain_left - n : 0;
+	}
+	denormal_leave (clv, csr);
+	return clv->drain_left;
 }
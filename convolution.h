@@ -28,7 +28,9 @@
 #define VERBOSE_printf(FMT, ...) fprintf(stderr, FMT, ##__VA_ARGS__)
 
 
-#define MAX_CHANNEL_MAPS (4)
+#define MAX_CHANNELS (16) ///< max. inputs and outputs
+#define MAX_CHANNEL_MAPS (64) ///< max. IR routes, in -> out
+#define MAX_PROGRAMS (16) ///< max. IRs in a bank
 
 /* zita-convolver lib is C++ so we need extern "C" in order to link
  * functions using it. */
@@ -42,15 +44,48 @@ extern LV2convolv *clv_alloc();
 extern void clv_free (LV2convolv *clv);
 
 int clv_configure (LV2convolv *clv, const char *key, const char *value);
+/* returns 0 on success, -1 on error and -2 if aborted by the abort callback */
 extern int clv_initialize (LV2convolv *clv, const unsigned int sample_rate, const unsigned int in_channel_cnt, const unsigned int out_channel_cnt, const unsigned int buffersize);
 extern void clv_release (LV2convolv *clv);
 void clv_clone_settings(LV2convolv *clv_new, LV2convolv *clv);
 
+/* add the tail of an engine that was taken offline to the output,
+ * returns the number of samples remaining */
+extern int clv_drain (LV2convolv *clv, float * const* outbuf, const unsigned int out_channel_cnt, const unsigned int n_samples, const float gain_start, const float gain_end);
+
 extern int clv_convolve (LV2convolv *clv, const float * const * inbuf, float * const* outbuf, const unsigned int in_channel_cnt, const unsigned int out_channel_cnt, const unsigned int n_samples, const float output_gain);
+/* as clv_convolve(), the output gain is interpolated per sample from gain_start to gain_end */
+extern int clv_convolve_ramp (LV2convolv *clv, const float * const * inbuf, float * const* outbuf, const unsigned int in_channel_cnt, const unsigned int out_channel_cnt, const unsigned int n_samples, const float gain_start, const float gain_end);
+
+/* after clv_initialize(): fault in and, with convolution.mlock=1, lock the engine's buffers,
+ * then process silence until every partition has run once, waiting for background partitions.
+ * Not realtime safe. Returns 0 on success, -2 if aborted by the abort callback */
+int clv_warmup (LV2convolv *clv);
 
 int clv_query_setting (LV2convolv *clv, const char *key, char *value, size_t val_max_len);
 char *clv_dump_settings (LV2convolv *clv);
 int clv_is_active (LV2convolv *clv);
+void clv_set_thread_reference (LV2convolv *clv, int policy, int priority);
+void clv_set_buffered (LV2convolv *clv, int buffered);
+/* switch an initialized zero-latency engine to buffered processing of arbitrary block-lengths,
+ * the latency becomes one fragment, which is silent. Realtime safe, returns 0 on success */
+int clv_rebuffer (LV2convolv *clv);
+unsigned int clv_latency (LV2convolv *clv);
+unsigned int clv_fragment_size (LV2convolv *clv);
+/* time spent in the engine during the last clv_convolve() or clv_drain() call, in ms */
+double clv_process_time (LV2convolv *clv);
+void clv_set_standby (LV2convolv *clv, int standby);
+/* cb is called by clv_initialize() between steps (file read, IR preparation, FFT planning, each route)
+ * and by clv_warmup() between periods, a non-zero return value aborts the initialization. The callback is inherited by clv_clone_settings(). */
+void clv_set_abort_callback (LV2convolv *clv, int (*cb) (void *arg), void *arg);
+int clv_same_settings (LV2convolv *a, LV2convolv *b);
+/* switch to a preloaded IR of the bank (realtime safe), the output is crossfaded */
+int clv_select_program (LV2convolv *clv, unsigned int program);
+/* route mixer (convolution.mix=1): linear gain and delay in samples of route 0..MAX_CHANNEL_MAPS-1,
+ * applied after the convolution. Lock-free, the latest value of each route is used from the next
+ * clv_convolve() on. Returns -1 for invalid arguments only */
+int clv_set_route_gain (LV2convolv *clv, unsigned int route, float gain);
+int clv_set_route_delay (LV2convolv *clv, unsigned int route, unsigned int delay);
 
 #ifdef __cplusplus
 }
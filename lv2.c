@@ -20,6 +20,8 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 #include "convolution.h"
 
 #ifdef HAVE_LV2_1_18_6
@@ -42,34 +44,55 @@
 
 #include "./uris.h"
 
-#ifndef MAX
-#define MAX(a,b) ( ((a)<(b))?(b):(a) )
-#endif
-
-/* note: when whaning this, update MAX_CHANNEL_MAPS in convolution.h to (MAX_CHN * MAX_CHN) */
-#define MAX_CHN (2)
-/* loop MACRO from 0 .. MAX_CHN */
-#define LOOP_DEFINE_PORTS(def) \
-  def(0) \
-  def(1)
-
-#define ENUMPORT(n) \
-  P_OUTPUT ## n = (n*2+3), \
-  P_INPUT ## n  = (n*2+4),
-
+/* note: must not exceed MAX_CHANNELS in convolution.h */
+#define MAX_CHN (16)
+
+/* plugin variants: URI fragment, inputs, outputs -- see also lv2ttl/ */
+#define LOOP_VARIANTS(def) \
+  def(Mono,            1,  1) \
+  def(Stereo,          2,  2) \
+  def(MonoToStereo,    1,  2) \
+  def(Quad,            4,  4) \
+  def(Surround51,      6,  6) \
+  def(AmbiToBinaural,  4,  2) \
+  def(Matrix16,       16, 16)
+
+/* audio ports start at P_AUDIO: interleaved output/input pairs,
+ * followed by the remaining outputs (or inputs) */
 typedef enum {
   P_CONTROL    = 0,
   P_NOTIFY     = 1,
   P_OUTGAIN    = 2,
-
-  LOOP_DEFINE_PORTS(ENUMPORT)
+  P_AUDIO      = 3,
 } PortIndex;
 
+/* control ports following the audio ports, relative to ctrl_port_base */
+typedef enum {
+  P_LATENCY    = 0,
+  P_DSPLOAD    = 1,
+  P_PROGRAM    = 2,
+} CtrlPortIndex;
+
 enum {
   CMD_APPLY    = 0,
-  CMD_FREE     = 1,
+  CMD_RETIRE   = 1,
+  CMD_SWAP     = 2,
+  CMD_LOAD     = 3,
+  CMD_KEEP     = 4,
 };
 
+/* engine instances passed between run() and the worker */
+typedef struct {
+  LV2_Atom    atom; ///< type: clv2_engine
+  int         cmd; ///< CMD_RETIRE: free engine, CMD_SWAP: new engine is ready, CMD_KEEP: it failed, no swap
+  int         handover; ///< CMD_SWAP: same IR and settings, the old engine's tail can be handed over
+  uint32_t    crossfade; ///< CMD_SWAP: crossfade length in samples, CMD_RETIRE: samples crossfaded
+  double      xfade_dsp; ///< CMD_RETIRE: time spent in the engine while crossfading, ms
+  LV2convolv* clv; ///< CMD_RETIRE: engine to free, CMD_SWAP: standby engine or NULL
+} EngineMessage;
+
+#define MAX_TAIL 2
+
 typedef struct {
   LV2_URID_Map*        map;
   LV2_Worker_Schedule* schedule;
@@ -84,6 +107,7 @@ typedef struct {
   LV2_Atom_Sequence*       notify_port;
 
   float * p_output_gain;
+  float * p_latency;
   float output_gain_db, output_gain_target, output_gain;
 
   LV2_Atom_Forge_Frame notify_frame;
@@ -92,18 +116,87 @@ typedef struct {
 
   LV2convolv *clv_online; ///< currently active engine
   LV2convolv *clv_offline; ///< inactive engine being configured
+  LV2convolv *clv_standby; ///< engine with minimal period, used when the block-size changes
+  LV2convolv *clv_tail[MAX_TAIL]; ///< retired engines, fed silence until their tail has decayed
+  LV2convolv *clv_fade; ///< previous engine, faded out after an IR change
+  char       *cfg_sent; ///< worker: settings and IR file of the engine last passed to run()
+
+  float*   fade_buf[MAX_CHN]; ///< output of clv_fade
+  uint32_t fade_buf_len; ///< size of fade_buf, max block-length
+  uint32_t fade_len; ///< crossfade length in samples
+  uint32_t fade_pos; ///< samples processed since the swap
+  double   fade_dsp; ///< time spent in clv_fade, ms
+
+  /* DSP load, accumulated by run() over dsp_window samples */
+  float*   p_dsp_load; ///< output port: average load in percent
+  uint32_t dsp_window; ///< report interval in samples
+  uint32_t dsp_samples; ///< samples processed in the current interval
+  uint32_t dsp_periods; ///< run() calls in the current interval
+  double   dsp_time; ///< engine time in the current interval, ms
+  double   dsp_peak; ///< max. load of a single period in the current interval
+  float    dsp_load; ///< average load of the last interval, percent
+
+  float*  p_program; ///< input port: IR program of the bank
+  float   program_port; ///< last value of p_program
+  int32_t program; ///< selected IR program, applied to new engines (-1: none)
+
+  /* route mixer, set by patch:Set, applied to new engines */
+  float    route_gain[MAX_CHANNEL_MAPS]; ///< linear gain per route
+  uint32_t route_delay[MAX_CHANNEL_MAPS]; ///< delay per route, samples
+  uint64_t route_gain_set; ///< bitmask: routes with a gain from patch:Set
+  uint64_t route_delay_set; ///< bitmask: routes with a delay from patch:Set
+
+  /* IR loads (patch:Set of convolv2:impulse), the worker only processes the latest request */
+  uint32_t load_requested; ///< loads scheduled by run(), atomic
+  uint32_t load_seen; ///< loads received by the worker
+  uint32_t load_done; ///< loads completed by the worker
+  uint32_t load_dropped; ///< superseded loads that were skipped or aborted
+  int      load_deferred; ///< a load waits for the pending swap, atomic
+  char     load_deferred_fn[1024]; ///< IR file of the deferred load, worker only
+  int      load_deferred_valid; ///< load_deferred_fn is the latest request, worker only
 
   int rate; ///< sample-rate -- constant per instance
   int chn_in; ///< input channel count -- constant per instance
   int chn_out; ///< output channel count --constant per instance
 
-  unsigned int bufsize;
+  unsigned int bufsize; ///< engine period
+  int buffered; ///< host block-lengths are not suitable, use buffered processing, atomic
+  int rebuffered; ///< the online engine was switched to buffered processing by run()
+  uint32_t ctrl_port_base; ///< index of the first control port after the audio ports
+
+  int rt_policy; ///< scheduling policy of the process thread, atomic
+  int rt_priority; ///< scheduling priority of the process thread, atomic
 
   short flag_reinit_in_progress;
   short flag_notify_ui; ///< notify UI about setting on next run()
+  short flag_sched_queried; ///< process thread's scheduling parameters are known
+  short flag_simd_logged; ///< selected DSP kernels have been logged
 
 } convoLV2;
 
+/* engine period for zero-latency processing of a block-length:
+ * the largest power of two that divides it, up to 8192. 0 if less than 64 */
+static uint32_t
+block_period(uint32_t n_samples)
+{
+  uint32_t q = n_samples & (~n_samples + 1);
+  if (q > 8192) {
+    q = 8192;
+  }
+  return q >= 64 ? q : 0;
+}
+
+/* engine period for buffered processing: the block-length rounded down to a power of two, 64..8192 */
+static uint32_t
+buffered_period(uint32_t n_samples)
+{
+  uint32_t q = 64;
+  while (q < 8192 && q * 2 <= n_samples) {
+    q *= 2;
+  }
+  return q;
+}
+
 static LV2_Handle
 instantiate(const LV2_Descriptor*     descriptor,
             double                    rate,
@@ -142,25 +235,43 @@ instantiate(const LV2_Descriptor*     descriptor,
   }
 
   LV2_URID bufsz_max = map->map(map->handle, LV2_BUF_SIZE__maxBlockLength);
+#ifdef LV2_BUF_SIZE__nominalBlockLength
+  LV2_URID bufsz_nom = map->map(map->handle, LV2_BUF_SIZE__nominalBlockLength);
+#endif
   LV2_URID atom_Int  = map->map(map->handle, LV2_ATOM__Int);
   uint32_t bufsize   = 0;
+  uint32_t maxsize   = 0;
+  uint32_t nominal   = 0;
+  int      buffered  = 0;
   for (const LV2_Options_Option* o = options; o->key; ++o) {
     if (o->context == LV2_OPTIONS_INSTANCE &&
         o->key == bufsz_max &&
         o->type == atom_Int) {
       bufsize = *(const int32_t*)o->value;
     }
+#ifdef LV2_BUF_SIZE__nominalBlockLength
+    if (o->context == LV2_OPTIONS_INSTANCE &&
+        o->key == bufsz_nom &&
+        o->type == atom_Int) {
+      nominal = *(const int32_t*)o->value;
+    }
+#endif
   }
 
+  maxsize = bufsize;
   if (bufsize == 0) {
     lv2_log_error(&logger, "No maximum buffer size given\n");
     return NULL;
-  } else if (bufsize < 64 || bufsize > 8192) {
-    lv2_log_error(&logger, "Buffer size %u out of range 64..8192\n", bufsize);
-    return NULL;
-  } else if (bufsize & (bufsize - 1)) {
-    lv2_log_error(&logger, "Buffer size %u not a power of two\n", bufsize);
-    return NULL;
+  }
+  /* zero latency if blocks are multiples of a power of two >= 64, larger
+   * blocks are processed in fragments. Otherwise process arbitrary
+   * block-lengths using an internal buffer, the engine's period is the
+   * nominal block-length rounded down to a power of two */
+  const uint32_t q = (bufsize & (bufsize - 1)) && nominal > 0 ? nominal : bufsize;
+  if ((bufsize = block_period(q)) == 0) {
+    buffered = 1;
+    bufsize = buffered_period(q);
+    lv2_log_note(&logger, "Block-length is not a multiple of 64, using buffered processing (latency: %u)\n", bufsize);
   }
 
   lv2_log_trace(&logger, "Buffer size: %u\n", bufsize);
@@ -179,12 +290,53 @@ instantiate(const LV2_Descriptor*     descriptor,
   self->log = log;
   self->logger = logger;
   self->bufsize = bufsize;
+  self->buffered = buffered;
   self->rate = rate;
   self->chn_in = 1;
   self->chn_out = 1;
+
+#define VARIANT(name, n_in, n_out) \
+  if (!strcmp(descriptor->URI, CONVOLV2_URI "#" #name)) { \
+    self->chn_in = n_in; \
+    self->chn_out = n_out; \
+  }
+  LOOP_VARIANTS(VARIANT)
+#undef VARIANT
+
+  self->ctrl_port_base = P_AUDIO + self->chn_in + self->chn_out;
   self->flag_reinit_in_progress = 0;
   self->clv_online = NULL;
   self->clv_offline = NULL;
+  self->clv_standby = NULL;
+  for (int i = 0; i < MAX_TAIL; ++i) {
+    self->clv_tail[i] = NULL;
+  }
+  self->clv_fade = NULL;
+  self->cfg_sent = NULL;
+  self->dsp_window = rate / 4;
+  self->program = -1;
+  self->program_port = -1;
+  self->route_gain_set = 0;
+  self->route_delay_set = 0;
+  self->load_requested = 0;
+  self->load_seen = 0;
+  self->load_done = 0;
+  self->load_dropped = 0;
+  self->load_deferred = 0;
+  self->load_deferred_valid = 0;
+  self->fade_buf_len = maxsize;
+  for (int i = 0; i < self->chn_out; ++i) {
+    self->fade_buf[i] = (float*)calloc(maxsize, sizeof(float));
+    if (!self->fade_buf[i]) {
+      for (int j = 0; j < i; ++j) {
+        free(self->fade_buf[j]);
+      }
+      free(self);
+      return NULL;
+    }
+  }
+  self->rt_policy = SCHED_OTHER;
+  self->rt_priority = 0;
 
   self->output_gain_db = 0;
   self->output_gain_target = self->output_gain = 1.0;
@@ -192,6 +344,160 @@ instantiate(const LV2_Descriptor*     descriptor,
   return (LV2_Handle)self;
 }
 
+static void
+log_stats(convoLV2* self, LV2convolv* clv)
+{
+  char late[32], load[32], bypass[32], periods[32], first[32], average[32];
+  if (clv_query_setting(clv, "convolution.stats.late", late, sizeof(late)) > 0
+      && clv_query_setting(clv, "convolution.stats.load", load, sizeof(load)) > 0
+      && strcmp(late, "0")) {
+    lv2_log_note(&self->logger, "convoLV2: background partitions late: %s periods, overloads: %s\n", late, load);
+  }
+  if (clv_query_setting(clv, "convolution.stats.bypass", bypass, sizeof(bypass)) > 0 && strcmp(bypass, "0")) {
+    lv2_log_trace(&self->logger, "convoLV2: %s periods of silent input were bypassed\n", bypass);
+  }
+  if (clv_query_setting(clv, "convolution.stats.periods", periods, sizeof(periods)) > 0
+      && clv_query_setting(clv, "convolution.stats.first", first, sizeof(first)) > 0
+      && clv_query_setting(clv, "convolution.stats.average", average, sizeof(average)) > 0
+      && strcmp(periods, "0")) {
+    lv2_log_trace(&self->logger, "convoLV2: first period: %s ms, average: %s ms (%s periods)\n", first, average, periods);
+  }
+}
+
+/* worker: schedule background threads relative to the process thread, as seen by run() */
+static void
+set_thread_reference(convoLV2* self, LV2convolv* clv)
+{
+  const int policy = __atomic_load_n(&self->rt_policy, __ATOMIC_ACQUIRE);
+  clv_set_thread_reference(clv, policy, __atomic_load_n(&self->rt_priority, __ATOMIC_RELAXED));
+}
+
+/* build an engine with the smallest period for the freshly initialized
+ * offline instance. It shares the decoded IR and is switched in by run()
+ * when the host changes the block-size, until the worker has prepared
+ * a dedicated engine. */
+static LV2convolv*
+prepare_standby(convoLV2* self)
+{
+  char val[8];
+  if (__atomic_load_n(&self->buffered, __ATOMIC_ACQUIRE) || self->bufsize <= 64) {
+    return NULL;
+  }
+  if (clv_query_setting(self->clv_offline, "convolution.standby", val, sizeof(val)) <= 0 || !atoi(val)) {
+    return NULL;
+  }
+  LV2convolv* clv = clv_alloc();
+  if (!clv) {
+    return NULL;
+  }
+  DEBUG_printf("Work: initialize standby instance\n");
+  clv_clone_settings(clv, self->clv_offline);
+  clv_set_standby(clv, 1);
+  set_thread_reference(self, clv);
+  if (clv_initialize(clv, self->rate, self->chn_in, self->chn_out, 64)) {
+    clv_free(clv);
+    return NULL;
+  }
+  return clv;
+}
+
+/* worker: settings and IR file of an engine, to compare against cfg_sent.
+ * The online engine belongs to run() and is not inspected. */
+static char*
+engine_settings(LV2convolv* clv)
+{
+  char fn[1024];
+  if (clv_query_setting(clv, "convolution.ir.file", fn, sizeof(fn)) <= 0) {
+    return NULL;
+  }
+  char *cfg = clv_dump_settings(clv);
+  char *rv = cfg ? (char*)malloc(strlen(cfg) + strlen(fn) + 22) : NULL;
+  if (rv) {
+    sprintf(rv, "%sconvolution.ir.file=%s\n", cfg, fn);
+  }
+  free(cfg);
+  return rv;
+}
+
+/* hand an engine to the worker to be freed */
+static void
+retire_xfade(convoLV2* self, LV2convolv* clv, uint32_t crossfade, double dsp)
+{
+  EngineMessage msg;
+  if (!clv) {
+    return;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.atom.size = sizeof(EngineMessage) - sizeof(LV2_Atom);
+  msg.atom.type = self->uris.clv2_engine;
+  msg.cmd = CMD_RETIRE;
+  msg.crossfade = crossfade;
+  msg.xfade_dsp = dsp;
+  msg.clv = clv;
+  self->schedule->schedule_work(self->schedule->handle, sizeof(msg), &msg);
+}
+
+static void
+retire(convoLV2* self, LV2convolv* clv)
+{
+  retire_xfade(self, clv, 0, 0);
+}
+
+/* end the crossfade, retire the previous engine */
+static void
+fade_done(convoLV2* self)
+{
+  retire_xfade(self, self->clv_fade, self->fade_pos, self->fade_dsp);
+  self->clv_fade = NULL;
+}
+
+/* keep running an engine that was taken offline with silent input,
+ * its output is the response to all previous input */
+static bool
+add_tail(convoLV2* self, LV2convolv* clv)
+{
+  if (!clv_is_active(clv) || clv_latency(clv) > 0) {
+    return false;
+  }
+  for (int i = 0; i < MAX_TAIL; ++i) {
+    if (!self->clv_tail[i]) {
+      self->clv_tail[i] = clv;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* a patch:Set of the IR file, without parsing the value */
+static bool
+is_load_request(const ConvoLV2URIs* uris, const LV2_Atom_Object* obj)
+{
+  const LV2_Atom* property = NULL;
+  if (obj->body.otype != uris->patch_Set) {
+    return false;
+  }
+  lv2_atom_object_get(obj, uris->patch_property, &property, 0);
+  return property && property->type == uris->atom_URID
+    && ((const LV2_Atom_URID*)property)->body == uris->clv2_impulse;
+}
+
+/* worker: a newer IR load has been scheduled by run().
+ * Also used as abort callback of clv_initialize() */
+static int
+load_superseded(void* arg)
+{
+  convoLV2* self = (convoLV2*)arg;
+  return (int32_t)(__atomic_load_n(&self->load_requested, __ATOMIC_ACQUIRE) - self->load_seen) > 0;
+}
+
+/* worker: skip a superseded load */
+static void
+load_drop(convoLV2* self)
+{
+  ++self->load_dropped;
+  DEBUG_printf("Work: drop superseded IR load\n");
+}
+
 static LV2_Worker_Status
 work(LV2_Handle                  instance,
      LV2_Worker_Respond_Function respond,
@@ -202,6 +508,67 @@ work(LV2_Handle                  instance,
   convoLV2* self = (convoLV2*)instance;
   int apply = 0;
 
+  if (size == sizeof(EngineMessage)
+      && ((const LV2_Atom*)data)->type == self->uris.clv2_engine) {
+    const EngineMessage* msg = (const EngineMessage*)data;
+    if (msg->cmd == CMD_RETIRE) {
+      DEBUG_printf("Work: free retired instance\n");
+      if (msg->crossfade > 0) {
+        lv2_log_trace(&self->logger, "convoLV2: crossfade %u samples, previous engine DSP: %.2f ms (%.1f%%)\n",
+                      msg->crossfade, msg->xfade_dsp,
+                      .1 * msg->xfade_dsp * self->rate / msg->crossfade);
+      }
+      log_stats(self, msg->clv);
+      clv_free(msg->clv);
+    }
+    return LV2_WORKER_SUCCESS;
+  }
+
+  /* IR loads are coalesced: only the latest request is initialized */
+  char path[1024];
+  bool load = false;
+  bool deferred = false;
+  if (size == sizeof(int)) {
+    load = deferred = *((const int*)data) == CMD_LOAD;
+  } else if (is_load_request(&self->uris, (const LV2_Atom_Object*)data)) {
+    ++self->load_seen;
+    load = true;
+  }
+  if (load && (load_superseded(self) || (deferred && !self->load_deferred_valid))) {
+    load_drop(self);
+    return LV2_WORKER_SUCCESS;
+  }
+  if (load) {
+    /* this request replaces a deferred one */
+    self->load_deferred_valid = 0;
+  }
+
+  if (deferred) {
+    strcpy(path, self->load_deferred_fn);
+  } else if (load) {
+    const LV2_Atom* file_path = read_set_file(&self->uris, (const LV2_Atom_Object*)data);
+    if (!file_path || file_path->size == 0 || file_path->size >= 1024) {
+      return LV2_WORKER_SUCCESS;
+    }
+    const char *fn = (const char*)(file_path+1);
+    strncpy (path, fn, file_path->size);
+    /* some version of jalv did not NULL terminate:
+     * https://github.com/drobilla/jalv/issues/32 */
+    path[file_path->size] = '\0';
+  }
+
+  if (load && clv_is_active(self->clv_offline)) {
+    /* the previous load is ready but not yet swapped in,
+     * run() schedules this one after work_response() */
+    DEBUG_printf("Work: defer IR load %s\n", path);
+    strcpy(self->load_deferred_fn, path);
+    self->load_deferred_valid = 1;
+    if (__atomic_exchange_n(&self->load_deferred, 1, __ATOMIC_ACQ_REL)) {
+      load_drop(self); // replaces a deferred load
+    }
+    return LV2_WORKER_SUCCESS;
+  }
+
   /* prepare new engine instance */
   if (!self->clv_offline) {
     DEBUG_printf("Work: allocate offline instance\n");
@@ -214,55 +581,103 @@ work(LV2_Handle                  instance,
     clv_clone_settings(self->clv_offline, self->clv_online);
   }
 
-  if (size == sizeof(int)) {
+  if (load) {
+    DEBUG_printf("load IR %s\n", path);
+    clv_configure(self->clv_offline, "convolution.ir.file", path);
+    apply = 1;
+  } else if (size == sizeof(int)) {
     switch(*((const int*)data)) {
     case CMD_APPLY:
       DEBUG_printf("Work: apply offline instance\n");
       apply = 1;
       break;
-    case CMD_FREE:
-      DEBUG_printf("Work: free offline instance\n");
-      clv_free(self->clv_offline);
-      self->clv_offline=NULL;
-      break;
     default:
       DEBUG_printf("Work: invalid command\n");
       break;
     }
   } else {
-    /* handle message described in Atom */
-    const LV2_Atom_Object* obj = (const LV2_Atom_Object*) data;
-    ConvoLV2URIs* uris = &self->uris;
-
-    if (obj->body.otype == uris->patch_Set) {
-      DEBUG_printf("Work: Atom Patch\n");
-      const LV2_Atom* file_path = read_set_file(uris, obj);
-      if (file_path && file_path->size > 0 && file_path->size < 1024) {
-        const char *fn = (const char*)(file_path+1);
-	char path[1024];
-	strncpy (path, fn, file_path->size);
-	/* some version of jalv did not NULL terminate:
-	 * https://github.com/drobilla/jalv/issues/32 */
-	path[file_path->size] = '\0';
-        DEBUG_printf("load IR %s\n", path);
-        clv_configure(self->clv_offline, "convolution.ir.file", path);
-        apply = 1;
-      }
-    } else {
-      DEBUG_printf("Work: Invalid Atom Msg\n");
-    }
+    DEBUG_printf("Work: Invalid Atom Msg\n");
   }
 
   if (apply) {
+    EngineMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.atom.size = sizeof(EngineMessage) - sizeof(LV2_Atom);
+    msg.atom.type = self->uris.clv2_engine;
+    msg.cmd = CMD_SWAP;
+    /* block-size change or re-applied state: the response of both
+     * engines is identical, the old one can finish its tail */
+    char *cfg = engine_settings(self->clv_offline);
+    msg.handover = cfg && self->cfg_sent && !strcmp(cfg, self->cfg_sent);
+    char val[16];
+    if (clv_query_setting(self->clv_offline, "convolution.crossfade", val, sizeof(val)) > 0) {
+      msg.crossfade = atoi(val) * self->rate / 1000;
+    }
+
     DEBUG_printf("Work: initialize offline instance\n");
-    clv_initialize(self->clv_offline, self->rate,
-                   self->chn_in, self->chn_out,
-                   /*64 <= buffer-size <=4096*/ self->bufsize);
-#if 1
-    respond(handle, 1, ""); // size must not be 0. A3 before rev 13146 will ignore it
-#else
-    respond(handle, 0, NULL);
-#endif
+    set_thread_reference(self, self->clv_offline);
+    clv_set_buffered(self->clv_offline, __atomic_load_n(&self->buffered, __ATOMIC_ACQUIRE));
+    /* a newer IR load aborts the initialization, the standby engine inherits this */
+    clv_set_abort_callback(self->clv_offline, load ? load_superseded : NULL, self);
+    if (self->program >= 0) {
+      /* start with the selected program, no crossfade */
+      char prog[16];
+      snprintf(prog, sizeof(prog), "%d", self->program);
+      clv_configure(self->clv_offline, "convolution.program", prog);
+    }
+    int rv = clv_initialize(self->clv_offline, self->rate,
+                            self->chn_in, self->chn_out,
+                            /*64 <= buffer-size <=4096*/ self->bufsize);
+    bool warmup_failed = false;
+    if (rv == 0) {
+      msg.clv = prepare_standby(self);
+      /* fault in (and lock) the buffers, so that the first periods in run() do not */
+      if ((rv = clv_warmup(self->clv_offline)) == -1) {
+        lv2_log_error(&self->logger, "convoLV2: engine warm-up failed, keeping the current engine\n");
+        warmup_failed = true;
+      }
+      if (rv || clv_warmup(msg.clv)) {
+        /* the standby engine is optional */
+        clv_free(msg.clv);
+        msg.clv = NULL;
+      }
+      if (!self->flag_simd_logged) {
+        char simd[16];
+        if (clv_query_setting(self->clv_offline, "convolution.simd", simd, sizeof(simd)) > 0) {
+          lv2_log_trace(&self->logger, "convoLV2: using %s DSP kernels\n", simd);
+        }
+        self->flag_simd_logged = 1;
+      }
+    }
+    if (rv == -2 || (load && load_superseded(self))) {
+      /* the next request starts with a fresh offline instance */
+      clv_free(msg.clv);
+      clv_free(self->clv_offline);
+      self->clv_offline = NULL;
+      load_drop(self);
+      free(cfg);
+      return LV2_WORKER_SUCCESS;
+    }
+    if (warmup_failed) {
+      /* the online engine continues */
+      clv_free(self->clv_offline);
+      self->clv_offline = NULL;
+      free(cfg);
+      msg.cmd = CMD_KEEP;
+      respond(handle, sizeof(msg), &msg);
+      return LV2_WORKER_SUCCESS;
+    }
+    if (load && rv == 0) {
+      ++self->load_done;
+      lv2_log_trace(&self->logger, "convoLV2: IR load completed, %u loaded, %u superseded requests dropped\n",
+                    self->load_done, self->load_dropped);
+    }
+    free(self->cfg_sent);
+    self->cfg_sent = rv == 0 ? cfg : NULL;
+    if (rv) {
+      free(cfg);
+    }
+    respond(handle, sizeof(msg), &msg);
   }
   return LV2_WORKER_SUCCESS;
 }
@@ -290,14 +705,44 @@ static void inform_ui(LV2_Handle instance) {
 #endif
 }
 
+/* pass the route mixer parameters to an engine that goes online, realtime safe */
+static void
+apply_routes(convoLV2* self)
+{
+  for (uint32_t r = 0; r < MAX_CHANNEL_MAPS; ++r) {
+    if (self->route_gain_set & (1ULL << r)) {
+      clv_set_route_gain(self->clv_online, r, self->route_gain[r]);
+    }
+    if (self->route_delay_set & (1ULL << r)) {
+      clv_set_route_delay(self->clv_online, r, self->route_delay[r]);
+    }
+  }
+}
+
 static LV2_Worker_Status
 work_response(LV2_Handle  instance,
               uint32_t    size,
               const void* data)
 {
   convoLV2* self = (convoLV2*)instance;
+  const EngineMessage* msg = NULL;
+
+  if (size == sizeof(EngineMessage)
+      && ((const LV2_Atom*)data)->type == self->uris.clv2_engine) {
+    msg = (const EngineMessage*)data;
+  }
+
+  if (msg && msg->cmd == CMD_KEEP) {
+    /* do not retry until the block-length changes again */
+    self->rebuffered = 0;
+    self->flag_reinit_in_progress = 0;
+    return LV2_WORKER_SUCCESS;
+  }
 
   if (!self->clv_offline) {
+    if (msg) {
+      retire(self, msg->clv);
+    }
     return LV2_WORKER_SUCCESS;
   }
 
@@ -305,27 +750,39 @@ work_response(LV2_Handle  instance,
   DEBUG_printf("Work: swap instances\n");
   LV2convolv *old  = self->clv_online;
   self->clv_online  = self->clv_offline;
-  self->clv_offline = old;
+  self->clv_offline = NULL;
 
-  self->flag_notify_ui = 1;
+  retire(self, self->clv_standby);
+  self->clv_standby = msg ? msg->clv : NULL;
+  self->rebuffered = 0;
 
-  int d = CMD_FREE;
-  self->schedule->schedule_work(self->schedule->handle, sizeof(int), &d);
+  /* the program may have changed while the engine was prepared */
+  if (self->program >= 0) {
+    clv_select_program(self->clv_online, self->program);
+    clv_select_program(self->clv_standby, self->program);
+  }
+  apply_routes(self);
+
+  if (msg && msg->handover && add_tail(self, old)) {
+    ;
+  } else if (msg && msg->crossfade > 0 && clv_is_active(old)) {
+    /* run both engines and crossfade */
+    if (self->clv_fade) {
+      fade_done(self);
+    }
+    self->clv_fade = old;
+    self->fade_len = msg->crossfade;
+    self->fade_pos = 0;
+    self->fade_dsp = 0;
+  } else {
+    retire(self, old);
+  }
 
+  self->flag_notify_ui = 1;
   self->flag_reinit_in_progress = 0;
   return LV2_WORKER_SUCCESS;
 }
 
-#define IOPORT(i) \
-    case P_INPUT ## i: \
-      self->input[i] = (float*)data; \
-      self->chn_in = MAX(self->chn_in,i+1); \
-      break; \
-    case P_OUTPUT ## i: \
-      self->output[i] = (float*)data; \
-      self->chn_out = MAX(self->chn_out,i+1); \
-      break;
-
 static void
 connect_port(LV2_Handle instance,
              uint32_t   port,
@@ -333,8 +790,41 @@ connect_port(LV2_Handle instance,
 {
   convoLV2* self = (convoLV2*)instance;
 
+  if (port >= self->ctrl_port_base) {
+    switch ((CtrlPortIndex)(port - self->ctrl_port_base)) {
+      case P_LATENCY:
+        self->p_latency = (float*)data;
+        break;
+      case P_DSPLOAD:
+        self->p_dsp_load = (float*)data;
+        break;
+      case P_PROGRAM:
+        self->p_program = (float*)data;
+        break;
+    }
+    return;
+  }
+
+  if (port >= P_AUDIO) {
+    const uint32_t a = port - P_AUDIO;
+    const uint32_t n_pairs = self->chn_in < self->chn_out ? self->chn_in : self->chn_out;
+    if (a < 2 * n_pairs) {
+      if (a & 1) {
+        self->input[a / 2] = (float*)data;
+      } else {
+        self->output[a / 2] = (float*)data;
+      }
+    } else if (self->chn_out > self->chn_in) {
+      self->output[a - n_pairs] = (float*)data;
+    } else {
+      self->input[a - n_pairs] = (float*)data;
+    }
+    return;
+  }
+
   switch ((PortIndex)port) {
-    LOOP_DEFINE_PORTS(IOPORT)
+    case P_AUDIO:
+      break;
     case P_CONTROL:
       self->control_port = (const LV2_Atom_Sequence*)data;
       break;
@@ -347,6 +837,51 @@ connect_port(LV2_Handle instance,
   }
 }
 
+/* set route gain [dB] or delay [samples] from a patch:Set vector, realtime safe.
+ * The standby engine receives them with apply_routes() when it goes online */
+static void
+set_routes(convoLV2* self, LV2_URID property, const float* values, uint32_t n_values)
+{
+  if (n_values > MAX_CHANNEL_MAPS) {
+    n_values = MAX_CHANNEL_MAPS;
+  }
+  for (uint32_t r = 0; r < n_values; ++r) {
+    const float v = values[r];
+    if (isnan(v)) {
+      continue;
+    }
+    if (property == self->uris.clv2_routeGain) {
+      const float gain = v <= -120.f ? 0.f : powf(10.f, .05f * fminf(v, 20.f));
+      if ((self->route_gain_set & (1ULL << r)) && self->route_gain[r] == gain) {
+        continue;
+      }
+      self->route_gain[r] = gain;
+      self->route_gain_set |= 1ULL << r;
+      clv_set_route_gain(self->clv_online, r, gain);
+    } else {
+      const uint32_t delay = v > 0 ? (uint32_t)rintf(fminf(v, 1048576.f)) : 0;
+      if ((self->route_delay_set & (1ULL << r)) && self->route_delay[r] == delay) {
+        continue;
+      }
+      self->route_delay[r] = delay;
+      self->route_delay_set |= 1ULL << r;
+      clv_set_route_delay(self->clv_online, r, delay);
+    }
+  }
+}
+
+/* switch the IR program of the active engines, realtime safe */
+static void
+select_program(convoLV2* self, int32_t program)
+{
+  if (program < 0 || program >= MAX_PROGRAMS) {
+    return;
+  }
+  self->program = program;
+  clv_select_program(self->clv_online, program);
+  clv_select_program(self->clv_standby, program);
+}
+
 static void
 run(LV2_Handle instance, uint32_t n_samples)
 {
@@ -371,7 +906,31 @@ run(LV2_Handle instance, uint32_t n_samples)
     self->output_gain_target = powf(10.f, 0.05f * g);
   }
 
-  self->output_gain += .08f * (self->output_gain_target - self->output_gain);
+  if (self->p_program && *self->p_program != self->program_port) {
+    self->program_port = *self->p_program;
+    select_program(self, (int32_t)rintf(self->program_port));
+  }
+
+  /* approach the target gain with a time-constant of 50ms, independent of
+   * the block-length. The engine interpolates per sample. */
+  const float gain_start = self->output_gain;
+  float gain_end = self->output_gain_target
+    + (gain_start - self->output_gain_target) * expf(-(float)n_samples / (.05f * self->rate));
+  if (fabsf(gain_end - self->output_gain_target) < 1e-5f) {
+    gain_end = self->output_gain_target;
+  }
+  self->output_gain = gain_end;
+
+  /* background threads are scheduled relative to the process thread */
+  if (!self->flag_sched_queried) {
+    struct sched_param param;
+    int policy;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+      __atomic_store_n(&self->rt_priority, param.sched_priority, __ATOMIC_RELAXED);
+      __atomic_store_n(&self->rt_policy, policy, __ATOMIC_RELEASE);
+    }
+    self->flag_sched_queried = 1;
+  }
 
   /* Set up forge to write directly to notify output port. */
   if (self->notify_port) {
@@ -384,43 +943,95 @@ run(LV2_Handle instance, uint32_t n_samples)
     lv2_atom_forge_sequence_head(&self->forge, &self->notify_frame, 0);
   }
 
-  bool silent = false;
-
-  /* re-init engine if block-size has changed */
-  if (self->bufsize != n_samples) {
-    /* verify if we support the new block-size */
-    if (n_samples < 64 || n_samples > 8192 ||
-        /* not power of two */ (n_samples & (n_samples - 1))
-        ) {
-      /* silence output ports */
-      for (i=0; i < self->chn_out; i++ ) {
-        memset(output[i], 0, sizeof(float) * n_samples);
+  /* re-init engine if block-size has changed, or when leaving buffered processing */
+  if ((self->bufsize != n_samples || self->buffered || self->rebuffered) && clv_is_active(self->clv_online)) {
+    /* Multiples of the engine's period are processed in fragments.
+     * Otherwise switch to the standby engine and let the current
+     * engine finish its tail, or continue with the current engine
+     * using an internal buffer (latency: one period), to bridge the
+     * gap until the worker has prepared an engine for the new block-size. */
+    const unsigned int period = clv_fragment_size(self->clv_online);
+    if (n_samples % period && clv_latency(self->clv_online) == 0) {
+      if (self->clv_standby
+          && n_samples % clv_fragment_size(self->clv_standby) == 0
+          && add_tail(self, self->clv_online)) {
+        self->clv_online  = self->clv_standby;
+        self->clv_standby = NULL;
+        apply_routes(self);
+      } else if (clv_rebuffer(self->clv_online) == 0) {
+        self->rebuffered = 1;
       }
-      silent = true;
+    }
+
+    /* zero latency if a power of two >= 64 divides the block-length,
+     * otherwise buffered processing, which handles any later block-length */
+    uint32_t q = block_period(n_samples);
+    const int buffered = q == 0;
+    int reinit;
+    if (buffered) {
+      q = buffered_period(n_samples);
+      reinit = !self->buffered;
     } else {
-      if (!self->flag_reinit_in_progress && clv_is_active(self->clv_online)) {
-	self->flag_reinit_in_progress = 1;
-	self->bufsize = n_samples;
-	int d = CMD_APPLY;
-	self->schedule->schedule_work(self->schedule->handle, sizeof(int), &d);
-      }
+      reinit = q != self->bufsize || self->buffered || self->rebuffered;
     }
+    if (reinit && !self->flag_reinit_in_progress) {
+      self->flag_reinit_in_progress = 1;
+      self->bufsize = q;
+      __atomic_store_n(&self->buffered, buffered, __ATOMIC_RELEASE);
+      int d = CMD_APPLY;
+      self->schedule->schedule_work(self->schedule->handle, sizeof(int), &d);
+    }
+  }
+
+  /* buffered processing handles any block-length */
+  const unsigned int latency = self->clv_online
+    ? clv_latency(self->clv_online)
+    : (self->buffered ? self->bufsize : 0);
+
+  if (self->p_latency) {
+    *self->p_latency = latency;
   }
 
   /* don't touch any settings if re-init is scheduled or in progress
    * TODO re-queue them ?
+   * Program and route mixer changes do not need the worker and are always applied.
    */
-  if (!self->flag_reinit_in_progress && self->control_port && self->notify_port) {
+  /* an IR load that arrived while the previous one waited for work_response() */
+  if (__atomic_load_n(&self->load_deferred, __ATOMIC_ACQUIRE) && !self->clv_offline) {
+    __atomic_store_n(&self->load_deferred, 0, __ATOMIC_RELAXED);
+    int d = CMD_LOAD;
+    self->schedule->schedule_work(self->schedule->handle, sizeof(int), &d);
+  }
+
+  if (self->control_port && self->notify_port) {
     /* Read incoming events */
     LV2_ATOM_SEQUENCE_FOREACH(self->control_port, ev) {
       const LV2_Atom_Object* obj = (LV2_Atom_Object*)&ev->body;
       ConvoLV2URIs* uris = &self->uris;
-      if (obj->body.otype == uris->patch_Get) {
+      int32_t program;
+      LV2_URID property;
+      const float* values;
+      uint32_t n_values;
+      if (read_set_program(uris, obj, &program)) {
+        select_program(self, program);
+      } else if ((n_values = read_set_route(uris, obj, &property, &values)) > 0) {
+        set_routes(self, property, values, n_values);
+      } else if (self->flag_reinit_in_progress) {
+        continue;
+      } else if (obj->body.otype == uris->patch_Get) {
         self->flag_notify_ui = 0;
         inform_ui(instance);
       } else {
         // TODO: parse message here and set self->flag_reinit_in_progres=1; IFF an apply would be triggered
-        self->schedule->schedule_work(self->schedule->handle, lv2_atom_total_size(&ev->body), &ev->body);
+        /* count IR loads before the worker can see them, it skips all but the latest */
+        const bool load = is_load_request(uris, obj);
+        if (load) {
+          __atomic_add_fetch(&self->load_requested, 1, __ATOMIC_RELEASE);
+        }
+        if (self->schedule->schedule_work(self->schedule->handle, lv2_atom_total_size(&ev->body), &ev->body) != LV2_WORKER_SUCCESS
+            && load) {
+          __atomic_sub_fetch(&self->load_requested, 1, __ATOMIC_RELEASE);
+        }
       }
     }
   }
@@ -431,13 +1042,81 @@ run(LV2_Handle instance, uint32_t n_samples)
     inform_ui(instance);
   }
 
-  if (silent) {
-    return;
+  /* previous engine, processed first: output may alias input */
+  bool fade = false;
+  double dsp_time = 0;
+  if (self->clv_fade) {
+    if (n_samples <= self->fade_buf_len) {
+      clv_convolve_ramp(self->clv_fade, input, self->fade_buf,
+                        self->chn_in,
+                        self->chn_out,
+                        n_samples, gain_start, gain_end);
+      self->fade_dsp += clv_process_time(self->clv_fade);
+      dsp_time += clv_process_time(self->clv_fade);
+      fade = true;
+    } else {
+      fade_done(self);
+    }
+  }
+
+  clv_convolve_ramp(self->clv_online, input, output,
+                    self->chn_in,
+                    self->chn_out,
+                    n_samples, gain_start, gain_end);
+  dsp_time += clv_process_time(self->clv_online);
+
+  if (fade) {
+    /* equal-power crossfade */
+    for (uint32_t s = 0; s < n_samples; ++s) {
+      const uint32_t p = self->fade_pos + s;
+      const float w = p < self->fade_len ? (float)M_PI_2 * p / self->fade_len : (float)M_PI_2;
+      const float g_in = sinf(w);
+      const float g_out = cosf(w);
+      for (i = 0; i < self->chn_out; ++i) {
+        output[i][s] = output[i][s] * g_in + self->fade_buf[i][s] * g_out;
+      }
+    }
+    self->fade_pos += n_samples;
+    if (self->fade_pos >= self->fade_len) {
+      fade_done(self);
+    }
+  }
+
+  for (i = 0; i < MAX_TAIL; ++i) {
+    if (!self->clv_tail[i]) {
+      continue;
+    }
+    const int remain = clv_drain(self->clv_tail[i], output, self->chn_out, n_samples, gain_start, gain_end);
+    dsp_time += clv_process_time(self->clv_tail[i]);
+    if (remain == 0) {
+      retire(self, self->clv_tail[i]);
+      self->clv_tail[i] = NULL;
+    }
+  }
+
+  /* DSP load: time spent in the engines relative to the period */
+  const double load = .1 * dsp_time * self->rate / n_samples;
+  self->dsp_time += dsp_time;
+  self->dsp_samples += n_samples;
+  self->dsp_periods += 1;
+  if (load > self->dsp_peak) {
+    self->dsp_peak = load;
+  }
+  if (self->dsp_samples >= self->dsp_window) {
+    self->dsp_load = .1 * self->dsp_time * self->rate / self->dsp_samples;
+    if (self->notify_port) {
+      lv2_atom_forge_frame_time(&self->forge, 0);
+      write_dsp_load(&self->forge, &self->uris, self->dsp_load, self->dsp_peak,
+                     self->dsp_time / self->dsp_periods);
+    }
+    self->dsp_time = 0;
+    self->dsp_samples = 0;
+    self->dsp_periods = 0;
+    self->dsp_peak = 0;
+  }
+  if (self->p_dsp_load) {
+    *self->p_dsp_load = self->dsp_load;
   }
-  clv_convolve(self->clv_online, input, output,
-               self->chn_in,
-               self->chn_out,
-               n_samples, self->output_gain);
 }
 
 static void
@@ -446,6 +1125,15 @@ cleanup(LV2_Handle instance)
   convoLV2* self = (convoLV2*)instance;
   clv_free(self->clv_online);
   clv_free(self->clv_offline);
+  clv_free(self->clv_standby);
+  for (int i = 0; i < MAX_TAIL; ++i) {
+    clv_free(self->clv_tail[i]);
+  }
+  clv_free(self->clv_fade);
+  free(self->cfg_sent);
+  for (int i = 0; i < MAX_CHN; ++i) {
+    free(self->fade_buf[i]);
+  }
   free(instance);
 }
 
@@ -663,37 +1351,20 @@ extension_data(const char* uri)
   return NULL;
 }
 
-static const LV2_Descriptor descriptor0 = {
-  CONVOLV2_URI "#Mono",
-  instantiate,
-  connect_port,
-  NULL, // activate,
-  run,
-  NULL, // deactivate,
-  cleanup,
-  extension_data
-};
-
-static const LV2_Descriptor descriptor1 = {
-  CONVOLV2_URI "#Stereo",
-  instantiate,
-  connect_port,
-  NULL, // activate,
-  run,
-  NULL, // deactivate,
-  cleanup,
-  extension_data
-};
-
-static const LV2_Descriptor descriptor2 = {
-  CONVOLV2_URI "#MonoToStereo",
-  instantiate,
-  connect_port,
-  NULL, // activate,
-  run,
-  NULL, // deactivate,
-  cleanup,
-  extension_data
+#define DESCRIPTOR(name, n_in, n_out) \
+  { \
+    CONVOLV2_URI "#" #name, \
+    instantiate, \
+    connect_port, \
+    NULL, /* activate */ \
+    run, \
+    NULL, /* deactivate */ \
+    cleanup, \
+    extension_data \
+  },
+
+static const LV2_Descriptor descriptors[] = {
+  LOOP_VARIANTS(DESCRIPTOR)
 };
 
 
@@ -707,15 +1378,9 @@ LV2_SYMBOL_EXPORT
 const LV2_Descriptor*
 lv2_descriptor(uint32_t index)
 {
-  switch (index) {
-  case 0:
-    return &descriptor0;
-  case 1:
-    return &descriptor1;
-  case 2:
-    return &descriptor2;
-  default:
-    return NULL;
+  if (index < sizeof(descriptors) / sizeof(LV2_Descriptor)) {
+    return &descriptors[index];
   }
+  return NULL;
 }
 /* vi:set ts=8 sts=2 sw=2: */
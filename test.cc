@@ -0,0 +1,850 @@
+/* convoLV2 -- LV2 convolution plugin
+ *
+ * Copyright (C) 2012 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Accuracy regression tests of the convolution engine.
+ *
+ * Every case writes an IR file, processes a deterministic signal with
+ * clv_initialize() and clv_convolve(), and compares the output with
+ * a brute-force time-domain convolution using the expected channel map.
+ * The plugin cases run lv2.c in a synchronous host, which calls the
+ * worker after every cycle.
+ *
+ *   convoLV2-test [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <sndfile.h>
+#include <samplerate.h>
+
+#ifdef HAVE_LV2_1_18_6
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/core/lv2.h>
+#include <lv2/options/options.h>
+#include <lv2/state/state.h>
+#include <lv2/worker/worker.h>
+#else
+#include <lv2/lv2plug.in/ns/ext/buf-size/buf-size.h>
+#include <lv2/lv2plug.in/ns/ext/options/options.h>
+#include <lv2/lv2plug.in/ns/ext/state/state.h>
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#endif
+
+#include "convolution.h"
+#include "uris.h"
+
+#ifndef SRC_QUALITY // must match convolution.cc
+# define SRC_QUALITY SRC_SINC_BEST_QUALITY
+#endif
+
+#define RATE         48000
+#define N_SAMPLES    16384
+#define MAX_ERROR_DB (-80.0) ///< max. error relative to the signal
+
+typedef struct {
+	unsigned int ir_chan; ///< IR file channel, 1-based; 0: end of list
+	unsigned int inp; ///< input channel, 1-based
+	unsigned int out; ///< output channel, 1-based
+	float gain;
+	unsigned int delay;
+} Route;
+
+typedef struct {
+	const char *name;
+	unsigned int n_in;
+	unsigned int n_out;
+	unsigned int ir_n_chan; ///< channels in the IR file
+	unsigned int ir_rate; ///< sample-rate of the IR file
+	unsigned int ir_len; ///< IR length in samples (at ir_rate)
+	unsigned int block_size;
+	int buffered;
+	const char *cfg; ///< additional settings, "key=value\n"
+	Route routes[MAX_CHANNEL_MAPS + 1];
+	unsigned int bank_switch; ///< IR bank with a 2nd program, selected at this sample; 0: no bank
+	unsigned int mix_change; ///< route mixer: after a burst of other values, set gain .25 and delay 300 of route 1 at this sample; 0: no change
+	unsigned int abort_at; ///< abort the first initialization at this checkpoint, then initialize again; 0: no abort
+	int warmup; ///< call clv_warmup() after initialization
+	unsigned int rebuffer_at; ///< switch the zero-latency engine to buffered processing at this sample; 0: no switch
+} TestCase;
+
+#define MIX_SETTLE 2048 ///< samples after mix_change that are not compared: latency and gain ramp
+#define REBUFFER_VAR 4096 ///< samples after rebuffer_at that are processed in variable block-lengths
+
+static const TestCase tests[] = {
+	{ "1x1, mono IR", 1, 1, 1, RATE, 3000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x2, stereo IR", 1, 2, 2, RATE, 3000, 128, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } } },
+	{ "2x2, quad IR", 2, 2, 4, RATE, 3000, 64, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } } },
+	{ "1x2, too few channels: mono IR", 1, 2, 1, RATE, 3000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 1, 1, 2, .5f, 0 } } },
+	{ "2x2, too few channels: stereo IR", 2, 2, 2, RATE, 3000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 2, 2, .5f, 0 } } },
+	{ "2x2, too few channels: mono IR", 2, 2, 1, RATE, 3000, 512, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 1, 2, 2, .5f, 0 } } },
+	{ "1x2, too many channels: quad IR", 1, 2, 4, RATE, 3000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } } },
+	{ "1x1, too many channels: stereo IR", 1, 1, 2, RATE, 3000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x1, gain and pre-delay", 1, 1, 1, RATE, 3000, 256, 0,
+		"convolution.ir.gain.0=0.25\nconvolution.ir.delay.0=100\n",
+		{ { 1, 1, 1, .25f, 100 } } },
+	{ "2x2, per route gain and pre-delay", 2, 2, 4, RATE, 2000, 128, 0,
+		"convolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\nconvolution.ir.gain.3=1.0\nconvolution.ir.delay.3=1024\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, 1.f, 1024 } } },
+	{ "1x1, resampled IR 44.1k", 1, 1, 1, 44100, 3000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x2, resampled IR 96k", 1, 2, 2, 96000, 5000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } } },
+	{ "1x1, non-uniform partitioning", 1, 1, 1, RATE, 20000, 64, 0,
+		"convolution.partitioning=non-uniform\nconvolution.partition.max=1024\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x1, buffered", 1, 1, 1, RATE, 3000, 256, 1, "",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "2x2, FTZ/DAZ denormal protection", 2, 2, 4, RATE, 3000, 256, 0, "convolution.ftz=1\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } } },
+	{ "1x1, native engine", 1, 1, 1, RATE, 3000, 64, 0, "convolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x2, native engine, too few channels", 1, 2, 1, RATE, 3000, 256, 0, "convolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 }, { 1, 1, 2, .5f, 0 } } },
+	{ "2x2, native engine, per route gain and pre-delay", 2, 2, 4, RATE, 2000, 128, 0,
+		"convolution.engine=native\nconvolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\nconvolution.ir.gain.3=1.0\nconvolution.ir.delay.3=1024\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, 1.f, 1024 } } },
+	{ "1x1, native engine, buffered", 1, 1, 1, RATE, 3000, 256, 1, "convolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x1, silence bypass", 1, 1, 1, RATE, 500, 64, 0, "convolution.bypass=1\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "1x2, silence bypass, buffered", 1, 2, 2, RATE, 500, 256, 1, "convolution.bypass=1\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } } },
+	{ "1x1, hybrid FIR head", 1, 1, 1, RATE, 3000, 64, 0, "convolution.hybrid=1\nconvolution.hybrid.head=512\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "2x2, hybrid, per route gain and pre-delay", 2, 2, 4, RATE, 2000, 128, 0,
+		"convolution.hybrid=1\nconvolution.hybrid.head=512\nconvolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\nconvolution.ir.gain.3=1.0\nconvolution.ir.delay.3=1024\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, 1.f, 1024 } } },
+	{ "1x2, hybrid, native engine", 1, 2, 2, RATE, 3000, 64, 0, "convolution.hybrid=1\nconvolution.hybrid.head=256\nconvolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } } },
+	{ "1x1, hybrid, calibrated split", 1, 1, 1, RATE, 3000, 64, 0, "convolution.hybrid=1\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "4x4, 16 channel IR", 4, 4, 16, RATE, 2000, 128, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 1, 3, .5f, 0 }, { 4, 1, 4, .5f, 0 },
+		  { 5, 2, 1, .5f, 0 }, { 6, 2, 2, .5f, 0 }, { 7, 2, 3, .5f, 0 }, { 8, 2, 4, .5f, 0 },
+		  { 9, 3, 1, .5f, 0 }, { 10, 3, 2, .5f, 0 }, { 11, 3, 3, .5f, 0 }, { 12, 3, 4, .5f, 0 },
+		  { 13, 4, 1, .5f, 0 }, { 14, 4, 2, .5f, 0 }, { 15, 4, 3, .5f, 0 }, { 16, 4, 4, .5f, 0 } } },
+	{ "4x2, 8 channel IR, native engine", 4, 2, 8, RATE, 2000, 64, 0, "convolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 },
+		  { 5, 3, 1, .5f, 0 }, { 6, 3, 2, .5f, 0 }, { 7, 4, 1, .5f, 0 }, { 8, 4, 2, .5f, 0 } } },
+	{ "6x6, stereo IR wraps around the diagonal", 6, 6, 2, RATE, 2000, 256, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 2, 2, .5f, 0 }, { 1, 3, 3, .5f, 0 },
+		  { 2, 4, 4, .5f, 0 }, { 1, 5, 5, .5f, 0 }, { 2, 6, 6, .5f, 0 } } },
+	{ "16x16, 16 channel IR on the diagonal, native engine", 16, 16, 16, RATE, 1000, 64, 0, "convolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 2, 2, .5f, 0 }, { 3, 3, 3, .5f, 0 }, { 4, 4, 4, .5f, 0 },
+		  { 5, 5, 5, .5f, 0 }, { 6, 6, 6, .5f, 0 }, { 7, 7, 7, .5f, 0 }, { 8, 8, 8, .5f, 0 },
+		  { 9, 9, 9, .5f, 0 }, { 10, 10, 10, .5f, 0 }, { 11, 11, 11, .5f, 0 }, { 12, 12, 12, .5f, 0 },
+		  { 13, 13, 13, .5f, 0 }, { 14, 14, 14, .5f, 0 }, { 15, 15, 15, .5f, 0 }, { 16, 16, 16, .5f, 0 } } },
+	{ "2x2, custom routing matrix", 2, 2, 4, RATE, 2000, 128, 0,
+		"convolution.matrix=custom\nconvolution.ir.channel.0=4\nconvolution.source.0=2\nconvolution.output.0=1\n"
+		"convolution.ir.channel.5=1\nconvolution.source.5=1\nconvolution.output.5=1\nconvolution.ir.gain.5=0.25\n"
+		"convolution.ir.channel.63=2\nconvolution.source.63=2\nconvolution.output.63=2\nconvolution.ir.delay.63=100\n",
+		{ { 4, 2, 1, .5f, 0 }, { 1, 1, 1, .25f, 0 }, { 2, 2, 2, .5f, 100 } } },
+	{ "1x1, IR trim", 1, 1, 1, RATE, 6000, 64, 0, "convolution.ir.trim=-90\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "2x2, IR trim, native engine, per route gain and pre-delay", 2, 2, 4, RATE, 6000, 128, 0,
+		"convolution.ir.trim=-90\nconvolution.engine=native\nconvolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\nconvolution.ir.gain.3=1.0\nconvolution.ir.delay.3=1024\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, 1.f, 1024 } } },
+	{ "1x2, IR bank, program change", 1, 2, 2, RATE, 3000, 64, 0, "convolution.bank.fade=0\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } }, 8192 },
+	{ "2x2, IR bank, per route gain and pre-delay", 2, 2, 4, RATE, 2000, 128, 0,
+		"convolution.bank.fade=0\nconvolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } }, 4096 },
+	{ "1x1, reduced-rate tail 1/2", 1, 1, 1, RATE, 12000, 64, 0, "convolution.tail.factor=2\nconvolution.tail.split=1200\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "2x2, reduced-rate tail 1/4, native engine, per route gain and pre-delay", 2, 2, 4, RATE, 12000, 128, 0,
+		"convolution.tail.factor=4\nconvolution.tail.split=2500\nconvolution.engine=native\n"
+		"convolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\nconvolution.ir.gain.3=1.0\nconvolution.ir.delay.3=1024\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, 1.f, 1024 } } },
+	{ "2x2, compact IR spectra, native engine, per route gain and pre-delay", 2, 2, 4, RATE, 6000, 128, 0,
+		"convolution.compact=1\nconvolution.compact.split=1024\nconvolution.engine=native\n"
+		"convolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\nconvolution.ir.gain.3=1.0\nconvolution.ir.delay.3=1024\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, -.7f, 333 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, 1.f, 1024 } } },
+	{ "1x1, compact IR spectra, hybrid, native engine", 1, 1, 1, RATE, 6000, 64, 0,
+		"convolution.compact=1\nconvolution.compact.split=0\nconvolution.hybrid=1\nconvolution.hybrid.head=256\nconvolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 } } },
+	{ "2x2, route mixer, per route gain and delay", 2, 2, 4, RATE, 3000, 128, 0,
+		"convolution.mix=1\nconvolution.ir.gain.1=-0.7\nconvolution.ir.delay.1=333\n"
+		"convolution.mix.gain.0=2.0\nconvolution.mix.gain.1=0.5\nconvolution.mix.delay.1=100\nconvolution.mix.delay.3=1024\n",
+		{ { 1, 1, 1, 1.f, 0 }, { 2, 1, 2, -.35f, 433 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 1024 } } },
+	{ "2x2, route mixer, native engine, runtime gain and delay change", 2, 2, 4, RATE, 3000, 64, 0,
+		"convolution.mix=1\nconvolution.mix.delay.max=1000\nconvolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } }, 0, 6000 },
+	{ "1x2, route mixer, buffered, runtime gain and delay change", 1, 2, 2, RATE, 3000, 128, 1,
+		"convolution.mix=1\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } }, 0, 6000 },
+	{ "2x2, initialization aborted while setting IR data", 2, 2, 4, RATE, 3000, 64, 0, "",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } }, 0, 0, 6 },
+	{ "1x2, initialization aborted while loading the IR bank", 1, 2, 2, RATE, 3000, 64, 0, "convolution.bank.fade=0\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 } }, 8192, 0, 3 },
+	{ "2x2, warm-up, locked memory, native engine, route mixer", 2, 2, 4, RATE, 3000, 64, 0,
+		"convolution.mlock=1\nconvolution.engine=native\nconvolution.mix=1\nconvolution.mix.delay.1=100\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 100 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } }, 0, 0, 0, 1 },
+	{ "1x1, warm-up, non-uniform partitioning", 1, 1, 1, RATE, 20000, 64, 0,
+		"convolution.partitioning=non-uniform\nconvolution.partition.max=1024\n",
+		{ { 1, 1, 1, .5f, 0 } }, 0, 0, 0, 1 },
+	{ "1x1, hybrid, switched to buffered processing at runtime", 1, 1, 1, RATE, 3000, 64, 0,
+		"convolution.hybrid=1\nconvolution.hybrid.head=512\n",
+		{ { 1, 1, 1, .5f, 0 } }, 0, 0, 0, 0, 6016 },
+	{ "2x2, reduced-rate tail 1/2, native engine, switched to buffered processing at runtime", 2, 2, 4, RATE, 12000, 128, 0,
+		"convolution.tail.factor=2\nconvolution.tail.split=1200\nconvolution.engine=native\n",
+		{ { 1, 1, 1, .5f, 0 }, { 2, 1, 2, .5f, 0 }, { 3, 2, 1, .5f, 0 }, { 4, 2, 2, .5f, 0 } }, 0, 0, 0, 0, 8192 },
+};
+
+static unsigned int lcg_state;
+
+static unsigned int abort_calls;
+static unsigned int abort_at;
+
+/** clv_initialize() abort callback, aborts at the given checkpoint */
+static int abort_checkpoint (void *arg) {
+	return ++abort_calls >= abort_at;
+}
+
+/** deterministic pseudo-random numbers -.5 .. .5 */
+static float lcg (void) {
+	lcg_state = lcg_state * 1664525u + 1013904223u;
+	return (lcg_state >> 8) / (float) (1 << 24) - .5f;
+}
+
+static int write_ir (const char *fn, const float *ir, unsigned int n_chan, unsigned int n_frames, unsigned int rate) {
+	SF_INFO nfo;
+	memset (&nfo, 0, sizeof (nfo));
+	nfo.channels = n_chan;
+	nfo.samplerate = rate;
+	nfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+	SNDFILE *sf = sf_open (fn, SFM_WRITE, &nfo);
+	if (!sf) {
+		return -1;
+	}
+	const sf_count_t written = sf_writef_float (sf, ir, n_frames);
+	sf_close (sf);
+	return written == (sf_count_t) n_frames ? 0 : -1;
+}
+
+/** resample the IR the same way audiofile_read() does */
+static float *resample_ir (const float *ir, unsigned int n_chan, unsigned int *n_frames, unsigned int ir_rate) {
+	const double ratio = (float) RATE / (float) ir_rate;
+	const unsigned int n_out = *n_frames * ratio;
+	float *rv = (float*) calloc (n_chan * (n_out + 1), sizeof (float));
+	if (!rv) {
+		return NULL;
+	}
+	SRC_DATA src_data;
+	memset (&src_data, 0, sizeof (src_data));
+	src_data.input_frames  = *n_frames;
+	src_data.output_frames = n_out;
+	src_data.end_of_input  = 1;
+	src_data.src_ratio     = ratio;
+	src_data.data_in       = ir;
+	src_data.data_out      = rv;
+	if (src_simple (&src_data, SRC_QUALITY, n_chan)) {
+		free (rv);
+		return NULL;
+	}
+	*n_frames = src_data.output_frames_gen;
+	return rv;
+}
+
+/** brute-force convolution of one route, added to out */
+static void convolve_route (const float *in, float *out, const float *ir, unsigned int ir_n_chan,
+		unsigned int ir_len, const Route *r, unsigned int latency)
+{
+	for (unsigned int n = r->delay + latency; n < N_SAMPLES; ++n) {
+		const unsigned int m = n - r->delay - latency;
+		double acc = 0;
+		for (unsigned int k = 0; k < ir_len && k <= m; ++k) {
+			acc += ir[k * ir_n_chan + r->ir_chan - 1] * (double) in[m - k];
+		}
+		out[n] += r->gain * acc;
+	}
+}
+
+/** IR: decaying noise with a leading impulse.
+ * IR trim cases start with silence and end with a tail below -120 dB,
+ * reduced-rate tail cases use low-frequency partials (below RATE / 12) instead of noise */
+static float *make_ir (const TestCase *t, bool trim) {
+	unsigned int c, n, k;
+	const bool lowpass = strstr (t->cfg, "convolution.tail.factor") != NULL;
+	float freq[8], phase[8];
+	float *ir = (float*) malloc (t->ir_n_chan * t->ir_len * sizeof (float));
+	if (!ir) {
+		return NULL;
+	}
+	for (k = 0; k < 8; ++k) {
+		freq[k] = 2.f * M_PI * (.045f + .08f * lcg ());
+		phase[k] = 2.f * M_PI * lcg ();
+	}
+	for (n = 0; n < t->ir_len; ++n) {
+		for (c = 0; c < t->ir_n_chan; ++c) {
+			float v = 0;
+			if (lowpass) {
+				for (k = 0; k < 8; ++k) {
+					v += .25f * sinf (freq[k] * n + phase[k] + c);
+				}
+			} else {
+				v = lcg ();
+			}
+			ir[n * t->ir_n_chan + c] = (n == c ? 1.f : 0.f) + v * expf (-5.f * n / t->ir_len);
+			if (trim && n < 200 + 100 * c) {
+				ir[n * t->ir_n_chan + c] = 0.f;
+			} else if (trim && n >= t->ir_len / 2) {
+				ir[n * t->ir_n_chan + c] *= 1e-6f;
+			}
+		}
+	}
+	return ir;
+}
+
+static int run_test (const TestCase *t, const char *ir_fn, int verbose) {
+	float *ir = NULL, *ir_ref = NULL, *bank_ref = NULL;
+	float *in[MAX_CHANNELS];
+	float *out[MAX_CHANNELS];
+	float *ref[MAX_CHANNELS];
+	float *ref_bank[MAX_CHANNELS];
+	float *ref_mix[MAX_CHANNELS];
+	float *ref_lat[MAX_CHANNELS];
+	char bank_fn[1100];
+	unsigned int c, n;
+	int rv = -1;
+
+	memset (in, 0, sizeof (in));
+	memset (out, 0, sizeof (out));
+	memset (ref, 0, sizeof (ref));
+	memset (ref_bank, 0, sizeof (ref_bank));
+	memset (ref_mix, 0, sizeof (ref_mix));
+	memset (ref_lat, 0, sizeof (ref_lat));
+	snprintf (bank_fn, sizeof (bank_fn), "%s.bank.wav", ir_fn);
+
+	const bool trim = strstr (t->cfg, "convolution.ir.trim") != NULL;
+	lcg_state = 1;
+	if (!(ir = make_ir (t, trim))) {
+		return -1;
+	}
+	if (write_ir (ir_fn, ir, t->ir_n_chan, t->ir_len, t->ir_rate)) {
+		fprintf (stderr, "test: cannot write IR file '%s'\n", ir_fn);
+		free (ir);
+		return -1;
+	}
+
+	unsigned int ir_len = t->ir_len;
+	if (t->ir_rate != RATE) {
+		ir_ref = resample_ir (ir, t->ir_n_chan, &ir_len, t->ir_rate);
+	} else {
+		ir_ref = ir;
+		ir = NULL;
+	}
+	if (!ir_ref) {
+		goto errout;
+	}
+
+	/* 2nd program of the bank: a different IR of the same size */
+	if (t->bank_switch) {
+		const unsigned int seed = lcg_state;
+		lcg_state = 7;
+		bank_ref = make_ir (t, trim);
+		lcg_state = seed;
+		if (!bank_ref || write_ir (bank_fn, bank_ref, t->ir_n_chan, t->ir_len, t->ir_rate)) {
+			fprintf (stderr, "test: cannot write IR file '%s'\n", bank_fn);
+			goto errout;
+		}
+	}
+
+	/* input: impulse, noise, silence, sine */
+	for (c = 0; c < t->n_in; ++c) {
+		if (!(in[c] = (float*) calloc (N_SAMPLES, sizeof (float)))) goto errout;
+		in[c][c] = 1.f;
+		for (n = 1000; n < 6000; ++n) {
+			in[c][n] = lcg ();
+		}
+		for (n = 9000; n < N_SAMPLES; ++n) {
+			in[c][n] = .5f * sinf (2.f * M_PI * (440.f + 220.f * c) * n / RATE);
+		}
+	}
+	for (c = 0; c < t->n_out; ++c) {
+		if (!(out[c] = (float*) calloc (N_SAMPLES, sizeof (float)))) goto errout;
+		if (!(ref[c] = (float*) calloc (N_SAMPLES, sizeof (float)))) goto errout;
+		if (t->bank_switch && !(ref_bank[c] = (float*) calloc (N_SAMPLES, sizeof (float)))) goto errout;
+		if (t->mix_change && !(ref_mix[c] = (float*) calloc (N_SAMPLES, sizeof (float)))) goto errout;
+		if (t->rebuffer_at && !(ref_lat[c] = (float*) calloc (N_SAMPLES, sizeof (float)))) goto errout;
+	}
+
+	{
+		LV2convolv *clv = clv_alloc ();
+		if (!clv) {
+			goto errout;
+		}
+		clv_configure (clv, "convolution.ir.file", ir_fn);
+		if (t->bank_switch) {
+			clv_configure (clv, "convolution.bank.1", bank_fn);
+		}
+		const char *ts = t->cfg;
+		const char *te;
+		while (*ts && (te = strchr (ts, '\n'))) {
+			char kv[256];
+			char *val;
+			memcpy (kv, ts, te - ts);
+			kv[te - ts] = 0;
+			if ((val = strchr (kv, '='))) {
+				*val = 0;
+				clv_configure (clv, kv, val + 1);
+			}
+			ts = te + 1;
+		}
+		clv_set_buffered (clv, t->buffered);
+
+		if (t->abort_at) {
+			abort_calls = 0;
+			abort_at = t->abort_at;
+			clv_set_abort_callback (clv, abort_checkpoint, NULL);
+			if (clv_initialize (clv, RATE, t->n_in, t->n_out, t->block_size) != -2 || clv_is_active (clv)) {
+				fprintf (stderr, "test: clv_initialize was not aborted\n");
+				clv_free (clv);
+				goto errout;
+			}
+			clv_set_abort_callback (clv, NULL, NULL);
+		}
+
+		if (clv_initialize (clv, RATE, t->n_in, t->n_out, t->block_size)) {
+			fprintf (stderr, "test: clv_initialize failed\n");
+			clv_free (clv);
+			goto errout;
+		}
+		if (t->warmup && clv_warmup (clv)) {
+			fprintf (stderr, "test: clv_warmup failed\n");
+			clv_free (clv);
+			goto errout;
+		}
+
+		/* buffered processing accepts any block-length */
+		static const unsigned int var_len[] = { 17, 256, 1, 100, 511, 64 };
+		unsigned int k = 0;
+		bool mix_changed = false;
+		for (n = 0; n < N_SAMPLES;) {
+			/* after a switch to buffered processing, variable and then regular block-lengths */
+			const bool rebuffered = t->rebuffer_at && n >= t->rebuffer_at;
+			unsigned int len = t->buffered || (rebuffered && n < t->rebuffer_at + REBUFFER_VAR) ? var_len[k++ % 6] : t->block_size;
+			if (len > N_SAMPLES - n) {
+				len = N_SAMPLES - n;
+			}
+			const float *ip[MAX_CHANNELS];
+			float *op[MAX_CHANNELS];
+			for (c = 0; c < t->n_in; ++c) ip[c] = in[c] + n;
+			for (c = 0; c < t->n_out; ++c) op[c] = out[c] + n;
+			if (t->rebuffer_at && n == t->rebuffer_at
+					&& (clv_latency (clv) != 0 || clv_rebuffer (clv) || clv_latency (clv) != t->block_size)) {
+				fprintf (stderr, "test: clv_rebuffer failed\n");
+				clv_free (clv);
+				goto errout;
+			}
+			if (t->bank_switch && n == t->bank_switch && clv_select_program (clv, 1)) {
+				fprintf (stderr, "test: clv_select_program failed\n");
+				clv_free (clv);
+				goto errout;
+			}
+			if (t->mix_change && n >= t->mix_change && !mix_changed) {
+				mix_changed = true;
+				/* a burst of changes within one period: only the last values are used */
+				int set_failed = 0;
+				for (unsigned int k = 0; k < 1000; ++k) {
+					set_failed |= clv_set_route_gain (clv, 1, k / 1000.f) | clv_set_route_delay (clv, 1, k % 500);
+				}
+				if (set_failed || clv_set_route_gain (clv, 1, .25f) || clv_set_route_delay (clv, 1, 300)) {
+					fprintf (stderr, "test: clv_set_route_gain/delay failed\n");
+					clv_free (clv);
+					goto errout;
+				}
+			}
+			if (clv_convolve (clv, ip, op, t->n_in, t->n_out, len, 1.f) != (int) len) {
+				fprintf (stderr, "test: clv_convolve failed\n");
+				clv_free (clv);
+				goto errout;
+			}
+			n += len;
+		}
+
+		const unsigned int latency = clv_latency (clv);
+		char bypassed[32] = "0";
+		char length[32] = "0";
+		char programs[32] = "0";
+		char periods[32] = "0";
+		clv_query_setting (clv, "convolution.stats.bypass", bypassed, sizeof (bypassed));
+		clv_query_setting (clv, "convolution.length", length, sizeof (length));
+		clv_query_setting (clv, "convolution.programs", programs, sizeof (programs));
+		clv_query_setting (clv, "convolution.stats.periods", periods, sizeof (periods));
+		clv_free (clv);
+
+		if (verbose) {
+			printf ("  bypassed: %s periods, convolution length: %s, programs: %s\n", bypassed, length, programs);
+		}
+		if (t->bank_switch && strcmp (programs, "2")) {
+			printf ("  IR bank was not loaded (programs: %s)\n", programs);
+			goto errout;
+		}
+		/* the warm-up periods are not counted */
+		if (t->warmup && (unsigned int) atoi (periods) != (N_SAMPLES + t->block_size - 1) / t->block_size) {
+			printf ("  unexpected period count after warm-up: %s\n", periods);
+			goto errout;
+		}
+		/* the quiet tail must be removed */
+		if (trim && (unsigned int) atoi (length) >= t->ir_len) {
+			printf ("  IR was not trimmed (length %s)\n", length);
+			goto errout;
+		}
+		/* cases that enable it explicitly have enough silence in the input */
+		if (strstr (t->cfg, "convolution.bypass=1") && !strcmp (bypassed, "0")) {
+			printf ("  input silence was not bypassed\n");
+			goto errout;
+		}
+
+		for (const Route *r = t->routes; r->ir_chan > 0; ++r) {
+			convolve_route (in[r->inp - 1], ref[r->out - 1], ir_ref, t->ir_n_chan, ir_len, r, t->rebuffer_at ? 0 : latency);
+			if (t->rebuffer_at) {
+				convolve_route (in[r->inp - 1], ref_lat[r->out - 1], ir_ref, t->ir_n_chan, ir_len, r, latency);
+			}
+			if (t->bank_switch) {
+				convolve_route (in[r->inp - 1], ref_bank[r->out - 1], bank_ref, t->ir_n_chan, ir_len, r, latency);
+			}
+			if (t->mix_change) {
+				Route rm = *r;
+				if (r == &t->routes[1]) {
+					rm.gain *= .25f;
+					rm.delay += 300;
+				}
+				convolve_route (in[r->inp - 1], ref_mix[r->out - 1], ir_ref, t->ir_n_chan, ir_len, &rm, latency);
+			}
+		}
+		for (c = 0; c < t->n_out && t->mix_change; ++c) {
+			memcpy (ref[c] + t->mix_change, ref_mix[c] + t->mix_change, (N_SAMPLES - t->mix_change) * sizeof (float));
+		}
+		/* zero latency up to the switch, then one silent fragment, followed by the delayed output */
+		for (c = 0; c < t->n_out && t->rebuffer_at; ++c) {
+			memset (ref[c] + t->rebuffer_at, 0, latency * sizeof (float));
+			memcpy (ref[c] + t->rebuffer_at + latency, ref_lat[c] + t->rebuffer_at + latency,
+					(N_SAMPLES - t->rebuffer_at - latency) * sizeof (float));
+		}
+		/* programs share the input history: the switch is instant without crossfade */
+		for (c = 0; c < t->n_out && t->bank_switch; ++c) {
+			memcpy (ref[c] + t->bank_switch, ref_bank[c] + t->bank_switch, (N_SAMPLES - t->bank_switch) * sizeof (float));
+		}
+	}
+
+	rv = 0;
+	for (c = 0; c < t->n_out; ++c) {
+		double sig = 0, err = 0;
+		for (n = 0; n < N_SAMPLES; ++n) {
+			if (t->mix_change && n >= t->mix_change && n < t->mix_change + MIX_SETTLE) {
+				continue;
+			}
+			sig += ref[c][n] * (double) ref[c][n];
+			err += (out[c][n] - ref[c][n]) * (double) (out[c][n] - ref[c][n]);
+		}
+		const double db = 10. * log10 ((err + 1e-30) / (sig + 1e-30));
+		const bool ok = sig > 0 && db <= MAX_ERROR_DB;
+		if (!ok || verbose) {
+			printf ("  out %u: error %.1f dB%s\n", c + 1, db, ok ? "" : " -- exceeds tolerance");
+		}
+		if (!ok) {
+			rv = -1;
+		}
+	}
+
+errout:
+	for (c = 0; c < MAX_CHANNELS; ++c) {
+		free (in[c]);
+		free (out[c]);
+		free (ref[c]);
+		free (ref_bank[c]);
+		free (ref_mix[c]);
+		free (ref_lat[c]);
+	}
+	free (ir);
+	free (ir_ref);
+	free (bank_ref);
+	unlink (ir_fn);
+	unlink (bank_fn);
+	return rv;
+}
+
+/* plugin host, see run_plugin_test() */
+
+#define HOST_MAX_URIDS 64
+#define HOST_MAX_MSGS  16
+
+typedef struct {
+	uint32_t size;
+	char data[256];
+} HostMsg;
+
+static char *host_uris[HOST_MAX_URIDS];
+static unsigned int host_n_uris;
+static HostMsg host_work[HOST_MAX_MSGS];
+static unsigned int host_n_work;
+static const char *host_ir_fn;
+
+static LV2_URID host_map (LV2_URID_Map_Handle handle, const char *uri) {
+	unsigned int i;
+	for (i = 0; i < host_n_uris; ++i) {
+		if (!strcmp (host_uris[i], uri)) {
+			return i + 1;
+		}
+	}
+	if (host_n_uris == HOST_MAX_URIDS) {
+		return 0;
+	}
+	host_uris[host_n_uris] = strdup (uri);
+	return ++host_n_uris;
+}
+
+static LV2_Worker_Status host_queue (HostMsg *q, unsigned int *n, uint32_t size, const void *data) {
+	if (*n == HOST_MAX_MSGS || size > sizeof (q->data)) {
+		return LV2_WORKER_ERR_NO_SPACE;
+	}
+	q[*n].size = size;
+	memcpy (q[*n].data, data, size);
+	++*n;
+	return LV2_WORKER_SUCCESS;
+}
+
+static LV2_Worker_Status host_schedule (LV2_Worker_Schedule_Handle handle, uint32_t size, const void *data) {
+	return host_queue (host_work, &host_n_work, size, data);
+}
+
+static HostMsg host_resp[HOST_MAX_MSGS];
+static unsigned int host_n_resp;
+
+static LV2_Worker_Status host_respond (LV2_Worker_Respond_Handle handle, uint32_t size, const void *data) {
+	return host_queue (host_resp, &host_n_resp, size, data);
+}
+
+/** the worker thread, and work_response() at the end of the cycle */
+static void host_run_worker (const LV2_Worker_Interface *worker, LV2_Handle h) {
+	while (host_n_work > 0) {
+		HostMsg msg = host_work[0];
+		memmove (host_work, host_work + 1, --host_n_work * sizeof (HostMsg));
+		worker->work (h, host_respond, NULL, msg.size, msg.data);
+		for (unsigned int i = 0; i < host_n_resp; ++i) {
+			worker->work_response (h, host_resp[i].size, host_resp[i].data);
+		}
+		host_n_resp = 0;
+	}
+}
+
+static const void *host_retrieve (LV2_State_Handle handle, uint32_t key, size_t *size, uint32_t *type, uint32_t *flags) {
+	static const char cfg[] = "";
+	*flags = 0;
+	*type = 0;
+	if (key == host_map (NULL, CLV2__state)) {
+		*size = sizeof (cfg);
+		return cfg;
+	}
+	if (key == host_map (NULL, CLV2__impulse)) {
+		*size = strlen (host_ir_fn) + 1;
+		return host_ir_fn;
+	}
+	return NULL;
+}
+
+static char *host_absolute_path (LV2_State_Map_Path_Handle handle, const char *path) {
+	return strdup (path);
+}
+
+static char *host_abstract_path (LV2_State_Map_Path_Handle handle, const char *path) {
+	return strdup (path);
+}
+
+/** Mono plugin: 256-frame blocks, a split cycle of 100 frames and more of them, then 256-frame blocks again.
+ * The latency is reported when the blocks do not fit, and the plugin returns to zero latency */
+static int run_plugin_test (const char *ir_fn, int verbose) {
+	const unsigned int ir_len = 3000;
+	const Route route = { 1, 1, 1, .5f, 0 };
+	float *ir = (float*) malloc (ir_len * sizeof (float));
+	float *in = (float*) calloc (N_SAMPLES, sizeof (float));
+	float *out = (float*) calloc (N_SAMPLES, sizeof (float));
+	float *ref = (float*) calloc (N_SAMPLES, sizeof (float));
+	LV2_Handle h = NULL;
+	unsigned int n, k;
+	int rv = -1;
+
+	if (!ir || !in || !out || !ref) {
+		goto errout;
+	}
+	lcg_state = 1;
+	for (n = 0; n < ir_len; ++n) {
+		ir[n] = (n == 0 ? 1.f : 0.f) + lcg () * expf (-5.f * n / ir_len);
+	}
+	for (n = 0; n < N_SAMPLES; ++n) {
+		in[n] = lcg ();
+	}
+	if (write_ir (ir_fn, ir, 1, ir_len, RATE)) {
+		fprintf (stderr, "test: cannot write IR file '%s'\n", ir_fn);
+		goto errout;
+	}
+
+	{
+		host_ir_fn = ir_fn;
+		host_n_work = host_n_resp = 0;
+
+		int32_t max_block = 256;
+		LV2_URID_Map map = { NULL, host_map };
+		LV2_Worker_Schedule schedule = { NULL, host_schedule };
+		LV2_State_Map_Path map_path = { NULL, host_abstract_path, host_absolute_path };
+		const LV2_Options_Option options[] = {
+			{ LV2_OPTIONS_INSTANCE, 0, host_map (NULL, LV2_BUF_SIZE__maxBlockLength), sizeof (int32_t), host_map (NULL, LV2_ATOM__Int), &max_block },
+			{ LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, NULL }
+		};
+		const LV2_Feature f_map = { LV2_URID__map, &map };
+		const LV2_Feature f_schedule = { LV2_WORKER__schedule, &schedule };
+		const LV2_Feature f_options = { LV2_OPTIONS__options, (void*) options };
+		const LV2_Feature f_map_path = { LV2_STATE__mapPath, &map_path };
+		const LV2_Feature *features[] = { &f_map, &f_schedule, &f_options, NULL };
+		const LV2_Feature *state_features[] = { &f_map_path, NULL };
+
+		const LV2_Descriptor *desc = lv2_descriptor (0); // Mono
+		if (!desc || !(h = desc->instantiate (desc, RATE, "", features))) {
+			fprintf (stderr, "test: cannot instantiate the plugin\n");
+			goto errout;
+		}
+		const LV2_Worker_Interface *worker = (const LV2_Worker_Interface*) desc->extension_data (LV2_WORKER__interface);
+		const LV2_State_Interface *state = (const LV2_State_Interface*) desc->extension_data (LV2_STATE__interface);
+
+		float gain = 0, latency = -1, dsp_load = 0, program = 0;
+		desc->connect_port (h, 0, NULL); // control
+		desc->connect_port (h, 1, NULL); // notify
+		desc->connect_port (h, 2, &gain);
+		desc->connect_port (h, 5, &latency);
+		desc->connect_port (h, 6, &dsp_load);
+		desc->connect_port (h, 7, &program);
+
+		if (state->restore (h, host_retrieve, NULL, 0, state_features) != LV2_STATE_SUCCESS) {
+			fprintf (stderr, "test: cannot restore the plugin state\n");
+			goto errout;
+		}
+		host_run_worker (worker, h);
+
+		static const unsigned int block[] = { 256, 100, 256 };
+		static const unsigned int n_blocks[] = { 8, 40, 40 };
+		unsigned int settled = N_SAMPLES;
+		for (n = 0, k = 0; k < 3; ++k) {
+			for (unsigned int b = 0; b < n_blocks[k] && n + block[k] <= N_SAMPLES; ++b) {
+				desc->connect_port (h, 3, out + n);
+				desc->connect_port (h, 4, in + n);
+				desc->run (h, block[k]);
+				n += block[k];
+				host_run_worker (worker, h);
+				if (k == 1 && latency == 0) {
+					printf ("  no latency reported for %u-frame blocks\n", block[k]);
+					goto errout;
+				}
+				if (k == 2 && latency == 0 && settled == N_SAMPLES) {
+					/* a new engine, its output is complete after the IR length */
+					settled = n + ir_len;
+				}
+			}
+			if (verbose) {
+				printf ("  %u-frame blocks: latency %.0f\n", block[k], latency);
+			}
+		}
+		if (latency != 0) {
+			printf ("  latency %.0f after returning to %u-frame blocks\n", latency, block[2]);
+			goto errout;
+		}
+
+		convolve_route (in, ref, ir, 1, ir_len, &route, 0);
+		double sig = 0, err = 0;
+		for (k = settled; k < n; ++k) {
+			sig += ref[k] * (double) ref[k];
+			err += (out[k] - ref[k]) * (double) (out[k] - ref[k]);
+		}
+		const double db = 10. * log10 ((err + 1e-30) / (sig + 1e-30));
+		if (sig == 0 || db > MAX_ERROR_DB || verbose) {
+			printf ("  out 1: error %.1f dB%s\n", db, sig > 0 && db <= MAX_ERROR_DB ? "" : " -- exceeds tolerance");
+		}
+		rv = sig > 0 && db <= MAX_ERROR_DB ? 0 : -1;
+		desc->cleanup (h);
+		h = NULL;
+	}
+
+errout:
+	if (h) {
+		lv2_descriptor (0)->cleanup (h);
+	}
+	free (ir);
+	free (in);
+	free (out);
+	free (ref);
+	unlink (ir_fn);
+	return rv;
+}
+
+int main (int argc, char **argv) {
+	int verbose = 0;
+	int failed = 0;
+	int o;
+
+	while ((o = getopt (argc, argv, "v")) != -1) {
+		switch (o) {
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				fprintf (stderr, "Usage: convoLV2-test [-v]\n");
+				return 1;
+		}
+	}
+
+	const char *tmpdir = getenv ("TMPDIR");
+	if (!tmpdir || !*tmpdir) {
+		tmpdir = "/tmp";
+	}
+
+	const unsigned int n_tests = sizeof (tests) / sizeof (TestCase);
+	for (unsigned int i = 0; i < n_tests; ++i) {
+		char ir_fn[1024];
+		snprintf (ir_fn, sizeof (ir_fn), "%s/convoLV2-test-%d-%u.wav", tmpdir, (int) getpid (), i);
+		const int rv = run_test (&tests[i], ir_fn, verbose);
+		printf ("%s: %s\n", rv ? "FAIL" : "PASS", tests[i].name);
+		if (rv) {
+			++failed;
+		}
+	}
+	{
+		char ir_fn[1024];
+		snprintf (ir_fn, sizeof (ir_fn), "%s/convoLV2-test-%d-plugin.wav", tmpdir, (int) getpid ());
+		const int rv = run_plugin_test (ir_fn, verbose);
+		printf ("%s: %s\n", rv ? "FAIL" : "PASS", "Mono plugin, 256, 100 and again 256 frame blocks");
+		if (rv) {
+			++failed;
+		}
+	}
+	printf ("%u/%u tests passed\n", n_tests + 1 - failed, n_tests + 1);
+	return failed ? 1 : 0;
+}
@@ -198,6 +198,9 @@ port_event(LV2UI_Handle handle,
 
 		if (atom->type == ui->uris.atom_Blank || atom->type == ui->uris.atom_Object) {
 			LV2_Atom_Object* obj      = (LV2_Atom_Object*)atom;
+			if (obj->body.otype == ui->uris.clv2_dspLoad) {
+				return;
+			}
 			const LV2_Atom*  file_uri = read_set_file(&ui->uris, obj);
 			if (!file_uri) {
 				fprintf(stderr, "UI: Unknown message received from UI.\n");
@@ -35,8 +35,16 @@
 #define CONVOLV2_URI "http://gareus.org/oss/lv2/convoLV2"
 
 #define CLV2__impulse CONVOLV2_URI "#impulse"
+#define CLV2__program CONVOLV2_URI "#program"
+#define CLV2__routeGain  CONVOLV2_URI "#routeGain"
+#define CLV2__routeDelay CONVOLV2_URI "#routeDelay"
 #define CLV2__load    CONVOLV2_URI "#load"
 #define CLV2__state   CONVOLV2_URI "#state"
+#define CLV2__engine  CONVOLV2_URI "#engine"
+#define CLV2__dspLoad CONVOLV2_URI "#dspLoad"
+#define CLV2__loadAverage CONVOLV2_URI "#loadAverage"
+#define CLV2__loadPeak    CONVOLV2_URI "#loadPeak"
+#define CLV2__processTime CONVOLV2_URI "#processTime"
 
 #ifdef HAVE_LV2_1_8
 #define x_forge_object lv2_atom_forge_object
@@ -46,12 +54,23 @@
 
 typedef struct {
 	LV2_URID atom_Blank;
+	LV2_URID atom_Float;
+	LV2_URID atom_Int;
 	LV2_URID atom_Object;
 	LV2_URID atom_Path;
 	LV2_URID atom_String;
 	LV2_URID atom_URID;
+	LV2_URID atom_Vector;
 	LV2_URID atom_eventTransfer;
+	LV2_URID clv2_dspLoad;
+	LV2_URID clv2_loadAverage;
+	LV2_URID clv2_loadPeak;
+	LV2_URID clv2_processTime;
+	LV2_URID clv2_engine;
 	LV2_URID clv2_impulse;
+	LV2_URID clv2_program;
+	LV2_URID clv2_routeGain;
+	LV2_URID clv2_routeDelay;
 	LV2_URID clv2_state;
 	LV2_URID patch_Get;
 	LV2_URID patch_Set;
@@ -63,12 +82,23 @@ static inline void
 map_convolv2_uris(LV2_URID_Map* map, ConvoLV2URIs* uris)
 {
 	uris->atom_Blank         = map->map(map->handle, LV2_ATOM__Blank);
+	uris->atom_Float         = map->map(map->handle, LV2_ATOM__Float);
+	uris->atom_Int           = map->map(map->handle, LV2_ATOM__Int);
 	uris->atom_Object        = map->map(map->handle, LV2_ATOM__Object);
 	uris->atom_Path          = map->map(map->handle, LV2_ATOM__Path);
 	uris->atom_String        = map->map(map->handle, LV2_ATOM__String);
 	uris->atom_URID          = map->map(map->handle, LV2_ATOM__URID);
+	uris->atom_Vector        = map->map(map->handle, LV2_ATOM__Vector);
 	uris->atom_eventTransfer = map->map(map->handle, LV2_ATOM__eventTransfer);
+	uris->clv2_dspLoad       = map->map(map->handle, CLV2__dspLoad);
+	uris->clv2_loadAverage   = map->map(map->handle, CLV2__loadAverage);
+	uris->clv2_loadPeak      = map->map(map->handle, CLV2__loadPeak);
+	uris->clv2_processTime   = map->map(map->handle, CLV2__processTime);
+	uris->clv2_engine        = map->map(map->handle, CLV2__engine);
 	uris->clv2_impulse       = map->map(map->handle, CLV2__impulse);
+	uris->clv2_program       = map->map(map->handle, CLV2__program);
+	uris->clv2_routeGain     = map->map(map->handle, CLV2__routeGain);
+	uris->clv2_routeDelay    = map->map(map->handle, CLV2__routeDelay);
 	uris->clv2_state         = map->map(map->handle, CLV2__state);
 	uris->patch_Get          = map->map(map->handle, LV2_PATCH__Get);
 	uris->patch_Set          = map->map(map->handle, LV2_PATCH__Set);
@@ -102,6 +132,39 @@ write_set_file(LV2_Atom_Forge*     forge,
 	return set;
 }
 
+/**
+ * Write a message like the following to @p forge:
+ * []
+ *     a convolv2:dspLoad ;
+ *     convolv2:loadAverage 12.5 ;
+ *     convolv2:loadPeak 20.1 ;
+ *     convolv2:processTime 0.67 .
+ *
+ * load is in percent of the period, processTime the average per period in ms.
+ */
+static inline LV2_Atom*
+write_dsp_load(LV2_Atom_Forge*     forge,
+               const ConvoLV2URIs* uris,
+               float               load_avg,
+               float               load_peak,
+               float               proc_time)
+{
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom* msg = (LV2_Atom*)x_forge_object(
+		forge, &frame, 1, uris->clv2_dspLoad);
+
+	lv2_atom_forge_property_head(forge, uris->clv2_loadAverage, 0);
+	lv2_atom_forge_float(forge, load_avg);
+	lv2_atom_forge_property_head(forge, uris->clv2_loadPeak, 0);
+	lv2_atom_forge_float(forge, load_peak);
+	lv2_atom_forge_property_head(forge, uris->clv2_processTime, 0);
+	lv2_atom_forge_float(forge, proc_time);
+
+	lv2_atom_forge_pop(forge, &frame);
+
+	return msg;
+}
+
 /**
  * Get the file path from a message like:
  * []
@@ -146,4 +209,90 @@ read_set_file(const ConvoLV2URIs*    uris,
 	return file_path;
 }
 
+/**
+ * Get the program number from a message like:
+ * []
+ *     a patch:Set ;
+ *     patch:property convolv2:program ;
+ *     patch:value 2 .
+ *
+ * @return 0 if the message does not set the program
+ */
+static inline int
+read_set_program(const ConvoLV2URIs*    uris,
+                 const LV2_Atom_Object* obj,
+                 int32_t*               program)
+{
+	if (obj->body.otype != uris->patch_Set) {
+		return 0;
+	}
+
+	const LV2_Atom* property = NULL;
+	const LV2_Atom* value = NULL;
+	lv2_atom_object_get(obj, uris->patch_property, &property,
+	                    uris->patch_value, &value, 0);
+	if (!property || property->type != uris->atom_URID
+	    || ((const LV2_Atom_URID*)property)->body != uris->clv2_program) {
+		return 0;
+	}
+	if (!value || value->type != uris->atom_Int) {
+		fprintf(stderr, "Set message value is not an Int.\n");
+		return 0;
+	}
+
+	*program = ((const LV2_Atom_Int*)value)->body;
+	return 1;
+}
+
+/**
+ * Get the per route values from a message like:
+ * []
+ *     a patch:Set ;
+ *     patch:property convolv2:routeGain ;
+ *     patch:value [
+ *         a atom:Vector ;
+ *         atom:childType atom:Float ;
+ *         rdf:value ( 0.0 -6.0 0.0 -3.0 )
+ *     ] .
+ *
+ * The value is an atom:Vector of atom:Float, one element per route,
+ * for convolv2:routeGain or convolv2:routeDelay.
+ *
+ * @return the number of values, 0 if the message does not set route parameters
+ */
+static inline uint32_t
+read_set_route(const ConvoLV2URIs*    uris,
+               const LV2_Atom_Object* obj,
+               LV2_URID*              property_urid,
+               const float**          values)
+{
+	if (obj->body.otype != uris->patch_Set) {
+		return 0;
+	}
+
+	const LV2_Atom* property = NULL;
+	const LV2_Atom* value = NULL;
+	lv2_atom_object_get(obj, uris->patch_property, &property,
+	                    uris->patch_value, &value, 0);
+	if (!property || property->type != uris->atom_URID) {
+		return 0;
+	}
+	*property_urid = ((const LV2_Atom_URID*)property)->body;
+	if (*property_urid != uris->clv2_routeGain && *property_urid != uris->clv2_routeDelay) {
+		return 0;
+	}
+
+	const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)value;
+	if (!value || value->type != uris->atom_Vector
+	    || value->size < sizeof(LV2_Atom_Vector_Body)
+	    || vec->body.child_type != uris->atom_Float
+	    || vec->body.child_size != sizeof(float)) {
+		fprintf(stderr, "Set message value is not a Vector of Float.\n");
+		return 0;
+	}
+
+	*values = (const float*)(&vec->body + 1);
+	return (value->size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+}
+
 #endif